@@ -0,0 +1,36 @@
+#-------------------------------------------------
+#
+# Benchmarks for the server building blocks
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+CONFIG += c++11, c++14
+
+include(../server/server_core.pri)
+
+SOURCES += \
+        main.cpp \
+    codecbenchmark.cpp
+
+linux {
+    SOURCES += \
+        transportbenchmark.cpp \
+        loadbenchmark.cpp \
+        loopback.cpp
+
+    HEADERS += \
+        loopback.h
+}
+
+HEADERS += \
+    benchmarks.h
@@ -0,0 +1,13 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QStringList>
+
+namespace Benchmark
+{
+    int run_codec_benchmark(const QStringList &args);
+    int run_transport_benchmark(const QStringList &args);
+    int run_load_benchmark(const QStringList &args);
+}
+
+#endif // BENCHMARKS_H
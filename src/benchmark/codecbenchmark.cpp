@@ -0,0 +1,163 @@
+#include "benchmarks.h"
+
+#include "BaseServer/codec.h"
+
+#include <QDataStream>
+#include <QVector>
+#include <QTextStream>
+#include <QElapsedTimer>
+
+#include <tuple>
+
+namespace
+{
+    using FileCharacteristics = std::tuple<quint64,QString,QString>;
+
+    struct Entry
+    {
+        QString path;
+        FileCharacteristics data;
+        qint32 flags;
+    };
+
+    QVector<Entry> make_entries(int count)
+    {
+        QVector<Entry> entries;
+        entries.reserve(count);
+        for (int i = 0; i < count; i++)
+        {
+            entries.push_back({QString("/home/team/project/src/module_%1/file_%2.cpp").arg(i % 97).arg(i),
+                               std::make_tuple(static_cast<quint64>(i) * 4096, QString("2020-06-10T15:43:58"), QString("2020-06-11T09:12:01")),
+                               i});
+        }
+        return entries;
+    }
+
+    template<typename T>
+    QByteArray old_int_to_array(T source)
+    {
+        QByteArray temp;
+        QDataStream data(&temp, QIODevice::ReadWrite);
+        data << source;
+        return temp;
+    }
+
+    QByteArray encode_old(const QVector<Entry> &entries)
+    {
+        QByteArray out;
+        for (auto &entry : entries)
+        {
+            out += old_int_to_array(entry.path);
+            out += old_int_to_array(std::get<0>(entry.data));
+            out += old_int_to_array(std::get<1>(entry.data));
+            out += old_int_to_array(std::get<2>(entry.data));
+            out += old_int_to_array(entry.flags);
+        }
+        return out;
+    }
+
+    QByteArray encode_stream(const QVector<Entry> &entries)
+    {
+        QByteArray out;
+        QDataStream data(&out, QIODevice::WriteOnly);
+        for (auto &entry : entries)
+        {
+            data << entry.path << std::get<0>(entry.data) << std::get<1>(entry.data) << std::get<2>(entry.data) << entry.flags;
+        }
+        return out;
+    }
+
+    QByteArray encode_codec(const QVector<Entry> &entries)
+    {
+        int total = 0;
+        for (auto &entry : entries)
+        {
+            total += DataTransfer::Codec::encoded_size(entry.path, entry.data, entry.flags);
+        }
+        QByteArray out(total, Qt::Uninitialized);
+        char *current = out.data();
+        for (auto &entry : entries)
+        {
+            current = DataTransfer::Codec::write_all(current, entry.path, entry.data, entry.flags);
+        }
+        return out;
+    }
+
+    int decode_stream(const QByteArray &buffer, int count)
+    {
+        QDataStream data(buffer);
+        Entry entry;
+        int decoded = 0;
+        for (int i = 0; i < count && data.status() == QDataStream::Ok; i++)
+        {
+            data >> entry.path >> std::get<0>(entry.data) >> std::get<1>(entry.data) >> std::get<2>(entry.data) >> entry.flags;
+            decoded++;
+        }
+        return decoded;
+    }
+
+    int decode_codec(const QByteArray &buffer, int count)
+    {
+        DataTransfer::Codec::Reader reader(buffer);
+        Entry entry;
+        int decoded = 0;
+        for (int i = 0; i < count && reader.is_valid(); i++)
+        {
+            reader >> entry.path >> entry.data >> entry.flags;
+            decoded++;
+        }
+        return decoded;
+    }
+
+    template<typename Fun>
+    double measure_ns_per_entry(int iterations, int count, Fun fun)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; i++)
+        {
+            fun();
+        }
+        return static_cast<double>(timer.nsecsElapsed()) / iterations / count;
+    }
+}
+
+int Benchmark::run_codec_benchmark(const QStringList &args)
+{
+    const int count = 10000;
+    int iterations = args.isEmpty() ? 50 : args.first().toInt();
+    if(iterations <= 0)
+    {
+        iterations = 50;
+    }
+
+    QTextStream out(stdout);
+    auto entries = make_entries(count);
+
+    QByteArray reference = encode_stream(entries);
+    QByteArray encoded = encode_codec(entries);
+    if(reference != encoded || encode_old(entries) != encoded)
+    {
+        out << "codec output differs from QDataStream" << endl;
+        return 1;
+    }
+
+    volatile int sink = 0;
+    double old_encode = measure_ns_per_entry(iterations, count, [&]{ sink += encode_old(entries).size(); });
+    double stream_encode = measure_ns_per_entry(iterations, count, [&]{ sink += encode_stream(entries).size(); });
+    double codec_encode = measure_ns_per_entry(iterations, count, [&]{ sink += encode_codec(entries).size(); });
+    double stream_decode = measure_ns_per_entry(iterations, count, [&]{ sink += decode_stream(reference, count); });
+    double codec_decode = measure_ns_per_entry(iterations, count, [&]{ sink += decode_codec(encoded, count); });
+
+    out << "{\"benchmark\":\"codec\",\"entries\":" << count
+        << ",\"iterations\":" << iterations
+        << ",\"bytes\":" << encoded.size()
+        << ",\"ns_per_entry\":{"
+        << "\"encode_int_to_array\":" << old_encode
+        << ",\"encode_qdatastream\":" << stream_encode
+        << ",\"encode_codec\":" << codec_encode
+        << ",\"decode_qdatastream\":" << stream_decode
+        << ",\"decode_codec\":" << codec_decode
+        << "}}" << endl;
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include "benchmarks.h"
+
+#include "loopback.h"
+
+#include <QTextStream>
+
+#include <vector>
+#include <queue>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace lb = Benchmark::Loopback;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        QString backend = "qt";
+        int connections = 2000;
+        int message_size = 64;
+        int rate = 10;
+        int seconds = 10;
+        quint16 port = 45200;
+    };
+
+    struct Result
+    {
+        bool is_valid = false;
+        int connections = 0;
+        qint64 sent = 0;
+        qint64 received = 0;
+        double messages_per_sec = 0;
+        double rss_per_connection = 0;
+        qint64 p50 = 0;
+        qint64 p99 = 0;
+        qint64 p999 = 0;
+        qint64 max = 0;
+    };
+
+    struct Client
+    {
+        int descriptor;
+        QByteArray pending;
+    };
+
+    struct Send
+    {
+        qint64 time;
+        int index;
+
+        bool operator>(const Send &other)const
+        {
+            return time > other.time;
+        }
+    };
+
+    qint64 now_usec()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    qint64 percentile(std::vector<qint64> &values, double fraction)
+    {
+        if(values.empty())
+        {
+            return 0;
+        }
+        size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+        std::nth_element(values.begin(), values.begin() + static_cast<long>(index), values.end());
+        return values[index];
+    }
+
+    // Open loop: every client sends on its own schedule regardless of pending
+    // replies, so a slow server shows up as latency instead of a lower send rate.
+    // Each message carries its scheduled send time rather than the moment it
+    // left, so time the driver itself spends behind schedule is counted as
+    // latency too (no coordinated omission).
+    void drive_clients(std::vector<Client> &clients, const Options &options, Result &result)
+    {
+        const int message_size = std::max<int>(options.message_size, sizeof(qint64));
+        const qint64 interval = options.rate > 0 ? 1000000 / options.rate : 0;
+        QByteArray message(message_size, 'x');
+        std::vector<char> buffer(64 * 1024);
+        std::vector<qint64> latencies;
+        latencies.reserve(static_cast<size_t>(clients.size()) * std::max(1, options.rate) * options.seconds);
+
+        std::priority_queue<Send, std::vector<Send>, std::greater<Send>> schedule;
+        int epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+        qint64 start = now_usec();
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, clients[i].descriptor, &event);
+            // Spread the first sends over one interval to avoid a synchronized burst.
+            schedule.push({start + (interval > 0 ? interval * static_cast<qint64>(i) / static_cast<qint64>(clients.size()) : 0),
+                           static_cast<int>(i)});
+        }
+
+        auto send = [&](int index, qint64 time)
+        {
+            memcpy(message.data(), &time, sizeof(time));
+            if(lb::send_all(clients[index].descriptor, message.constData(), message.size()))
+            {
+                result.sent++;
+            }
+        };
+
+        const qint64 finish = start + options.seconds * 1000000LL;
+        std::vector<epoll_event> events(1024);
+        qint64 now = start;
+        while(now < finish)
+        {
+            while(interval > 0 && !schedule.empty() && schedule.top().time <= now)
+            {
+                Send next = schedule.top();
+                schedule.pop();
+                send(next.index, next.time);
+                schedule.push({next.time + interval, next.index});
+            }
+            if(interval == 0)
+            {
+                while(!schedule.empty())
+                {
+                    send(schedule.top().index, schedule.top().time);
+                    schedule.pop();
+                }
+            }
+
+            int timeout = 1;
+            if(interval > 0 && !schedule.empty())
+            {
+                timeout = static_cast<int>(qBound<qint64>(0, (schedule.top().time - now) / 1000, 100));
+            }
+            int count = epoll_wait(epoll_descriptor, events.data(), static_cast<int>(events.size()), timeout);
+            for (int i = 0; i < count; i++)
+            {
+                int index = static_cast<int>(events[i].data.u64);
+                Client &client = clients[static_cast<size_t>(index)];
+                ssize_t size = ::recv(client.descriptor, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if(size <= 0)
+                {
+                    continue;
+                }
+                client.pending.append(buffer.data(), static_cast<int>(size));
+
+                int offset = 0;
+                qint64 received_at = now_usec();
+                while(client.pending.size() - offset >= message_size)
+                {
+                    qint64 sent_at;
+                    memcpy(&sent_at, client.pending.constData() + offset, sizeof(sent_at));
+                    latencies.push_back(received_at - sent_at);
+                    offset += message_size;
+                    result.received++;
+                    if(interval == 0)
+                    {
+                        schedule.push({received_at, index});
+                    }
+                }
+                client.pending.remove(0, offset);
+            }
+            now = now_usec();
+        }
+        ::close(epoll_descriptor);
+
+        result.messages_per_sec = static_cast<double>(result.received) / options.seconds;
+        result.p50 = percentile(latencies, 0.50);
+        result.p99 = percentile(latencies, 0.99);
+        result.p999 = percentile(latencies, 0.999);
+        result.max = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+    }
+
+    Result measure(const Options &options, const lb::CountConnections &count_connections)
+    {
+        Result result;
+        qint64 rss_before = lb::resident_bytes();
+        auto descriptors = lb::open_clients(options.port, options.connections);
+        int opened = static_cast<int>(descriptors.size());
+        if(opened == 0 || !lb::wait_for([&]{ return count_connections() >= opened; }, 10000))
+        {
+            lb::close_clients(descriptors);
+            return result;
+        }
+
+        std::vector<Client> clients;
+        clients.reserve(descriptors.size());
+        for (int descriptor : descriptors)
+        {
+            clients.push_back({descriptor, QByteArray()});
+        }
+        drive_clients(clients, options, result);
+        qint64 rss_after = lb::resident_bytes();
+        lb::close_clients(descriptors);
+
+        result.is_valid = result.received > 0;
+        result.connections = opened;
+        result.rss_per_connection = static_cast<double>(rss_after - rss_before) / opened;
+        return result;
+    }
+
+    void print(QTextStream &out, const Options &options, const Result &result)
+    {
+        out << "{\"benchmark\":\"load\",\"backend\":\"" << options.backend
+            << "\",\"valid\":" << (result.is_valid ? "true" : "false")
+            << ",\"connections\":" << result.connections
+            << ",\"message_size\":" << options.message_size
+            << ",\"rate_per_connection\":" << options.rate
+            << ",\"seconds\":" << options.seconds
+            << ",\"sent\":" << result.sent
+            << ",\"received\":" << result.received
+            << ",\"messages_per_sec\":" << result.messages_per_sec
+            << ",\"latency_usec\":{\"p50\":" << result.p50
+            << ",\"p99\":" << result.p99
+            << ",\"p999\":" << result.p999
+            << ",\"max\":" << result.max
+            << "},\"rss_bytes_per_connection\":" << result.rss_per_connection
+            << "}" << endl;
+    }
+}
+
+int Benchmark::run_load_benchmark(const QStringList &args)
+{
+    Options options;
+    if(args.size() > 0)
+    {
+        options.backend = args[0];
+    }
+    if(args.size() > 1)
+    {
+        options.connections = qMax(1, args[1].toInt());
+    }
+    if(args.size() > 2)
+    {
+        options.message_size = qMax(1, args[2].toInt());
+    }
+    if(args.size() > 3)
+    {
+        options.rate = qMax(0, args[3].toInt());
+    }
+    if(args.size() > 4)
+    {
+        options.seconds = qMax(1, args[4].toInt());
+    }
+
+    lb::raise_descriptor_limit();
+    Result result;
+    auto measure_load = [&](const lb::CountConnections &count_connections)
+    {
+        result = measure(options, count_connections);
+    };
+    if(options.backend == "epoll")
+    {
+        lb::run_epoll_echo_server(options.port, measure_load);
+    }
+    else
+    {
+        options.backend = "qt";
+        lb::run_qt_echo_server(options.port, measure_load);
+    }
+
+    QTextStream out(stdout);
+    print(out, options, result);
+    return result.is_valid ? 0 : 1;
+}
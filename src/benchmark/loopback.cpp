@@ -0,0 +1,149 @@
+#include "loopback.h"
+
+#include "BaseServer/base_server.h"
+#include "BaseServer/epoll_server.h"
+
+#include <QThread>
+#include <QFile>
+
+#include <atomic>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace dt = DataTransfer;
+namespace lb = Benchmark::Loopback;
+
+qint64 lb::resident_bytes()
+{
+    QFile file("/proc/self/statm");
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+    QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+}
+
+void lb::raise_descriptor_limit()
+{
+    rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+std::vector<int> lb::open_clients(quint16 port, int count)
+{
+    std::vector<int> descriptors;
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < count; i++)
+    {
+        int descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(descriptor < 0 || ::connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if(descriptor >= 0)
+            {
+                ::close(descriptor);
+            }
+            break;
+        }
+        int no_delay = 1;
+        setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        descriptors.push_back(descriptor);
+    }
+    return descriptors;
+}
+
+void lb::close_clients(std::vector<int> &descriptors)
+{
+    for (int descriptor : descriptors)
+    {
+        ::close(descriptor);
+    }
+    descriptors.clear();
+}
+
+bool lb::send_all(int descriptor, const char *data, qint64 size)
+{
+    while(size > 0)
+    {
+        ssize_t count = ::send(descriptor, data, static_cast<size_t>(size), MSG_NOSIGNAL);
+        if(count <= 0)
+        {
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool lb::run_epoll_echo_server(quint16 port, const Measure &measure)
+{
+    dt::EpollServer server("127.0.0.1", port);
+    server.set_read_handler([&server](dt::EpollServer::Handle handle, const char *data, qint64 size)
+    {
+        server.write_data(handle, QByteArray::fromRawData(data, static_cast<int>(size)));
+    });
+    if(!server.run())
+    {
+        return false;
+    }
+    measure([&server]{ return server.count_connections(); });
+    server.stop();
+    return true;
+}
+
+bool lb::run_qt_echo_server(quint16 port, const Measure &measure)
+{
+    QThread thread;
+    dt::BaseServer *server = nullptr;
+    std::atomic_int count_connections(0);
+    std::atomic_int state(0);
+
+    QObject::connect(&thread, &QThread::started, [&]
+    {
+        server = new dt::BaseServer("127.0.0.1", port);
+        QObject::connect(server, &dt::BaseServer::new_connection, [&]
+        {
+            server->add_connection();
+            count_connections++;
+        });
+        QObject::connect(server, &dt::BaseServer::ready_data_read, [&](QTcpSocket *socket)
+        {
+            QByteArray data;
+            if(server->read_data(socket, data))
+            {
+                server->write_data(socket, data);
+            }
+        });
+        state = server->run() ? 1 : -1;
+    });
+    QObject::connect(&thread, &QThread::finished, [&]
+    {
+        delete server;
+    });
+
+    thread.start();
+    wait_for([&]{ return state != 0; }, 5000);
+    if(state == 1)
+    {
+        measure([&]{ return count_connections.load(); });
+    }
+    thread.quit();
+    thread.wait();
+    return state == 1;
+}
@@ -0,0 +1,51 @@
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+namespace Benchmark
+{
+    namespace Loopback
+    {
+        using CountConnections = std::function<int()>;
+        using Measure = std::function<void(const CountConnections &count_connections)>;
+
+        qint64 resident_bytes();
+        void raise_descriptor_limit();
+
+        std::vector<int> open_clients(quint16 port, int count);
+        void close_clients(std::vector<int> &descriptors);
+        bool send_all(int descriptor, const char *data, qint64 size);
+
+        // Both servers echo everything they read back to the sender and call
+        // measure() once they are listening. They return false if the server
+        // could not be started.
+        bool run_qt_echo_server(quint16 port, const Measure &measure);
+        bool run_epoll_echo_server(quint16 port, const Measure &measure);
+
+        template<typename Fun>
+        bool wait_for(Fun condition, int msec)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            while(!condition())
+            {
+                if(timer.elapsed() > msec)
+                {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return true;
+        }
+    }
+}
+
+#endif // LOOPBACK_H
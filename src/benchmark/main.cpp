@@ -0,0 +1,31 @@
+#include "benchmarks.h"
+
+#include <QCoreApplication>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments().mid(1);
+    QString name = args.isEmpty() ? QString("codec") : args.takeFirst();
+
+    if(name == "codec")
+    {
+        return Benchmark::run_codec_benchmark(args);
+    }
+#ifdef Q_OS_LINUX
+    if(name == "transport")
+    {
+        return Benchmark::run_transport_benchmark(args);
+    }
+    if(name == "load")
+    {
+        return Benchmark::run_load_benchmark(args);
+    }
+#endif
+
+    QTextStream(stderr) << "usage: benchmark codec [iterations]" << endl
+                        << "       benchmark transport [all|qt|epoll] [connections] [message_size] [seconds]" << endl
+                        << "       benchmark load [qt|epoll] [connections] [message_size] [rate_per_connection] [seconds]" << endl;
+    return 1;
+}
@@ -0,0 +1,173 @@
+#include "benchmarks.h"
+
+#include "loopback.h"
+
+#include <QTextStream>
+#include <QElapsedTimer>
+
+#include <vector>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace lb = Benchmark::Loopback;
+
+namespace
+{
+    struct Options
+    {
+        QString backend = "all";
+        int connections = 1000;
+        int message_size = 64;
+        int seconds = 5;
+        quint16 port = 45100;
+    };
+
+    struct Result
+    {
+        bool is_valid = false;
+        double messages_per_sec = 0;
+        double rss_per_connection = 0;
+    };
+
+    // Closed loop: every client keeps exactly one message in flight and sends the
+    // next one as soon as the echo of the previous one is complete.
+    qint64 drive_clients(const std::vector<int> &descriptors, int message_size, qint64 msec)
+    {
+        QByteArray message(message_size, 'x');
+        std::vector<qint64> received(descriptors.size(), 0);
+        std::vector<char> buffer(64 * 1024);
+        qint64 messages = 0;
+
+        int epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+        for (size_t i = 0; i < descriptors.size(); i++)
+        {
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, descriptors[i], &event);
+            lb::send_all(descriptors[i], message.constData(), message.size());
+        }
+
+        std::vector<epoll_event> events(1024);
+        QElapsedTimer timer;
+        timer.start();
+        while(timer.elapsed() < msec)
+        {
+            int count = epoll_wait(epoll_descriptor, events.data(), static_cast<int>(events.size()), 100);
+            for (int i = 0; i < count; i++)
+            {
+                size_t index = events[i].data.u64;
+                ssize_t size = ::recv(descriptors[index], buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if(size <= 0)
+                {
+                    continue;
+                }
+                received[index] += size;
+                while(received[index] >= message_size)
+                {
+                    received[index] -= message_size;
+                    messages++;
+                    lb::send_all(descriptors[index], message.constData(), message.size());
+                }
+            }
+        }
+        ::close(epoll_descriptor);
+        return messages;
+    }
+
+    Result measure(const Options &options, const lb::CountConnections &count_connections)
+    {
+        Result result;
+        qint64 rss_before = lb::resident_bytes();
+        auto clients = lb::open_clients(options.port, options.connections);
+        int opened = static_cast<int>(clients.size());
+        if(opened == 0 || !lb::wait_for([&]{ return count_connections() >= opened; }, 10000))
+        {
+            lb::close_clients(clients);
+            return result;
+        }
+
+        qint64 messages = drive_clients(clients, options.message_size, options.seconds * 1000);
+        qint64 rss_after = lb::resident_bytes();
+        lb::close_clients(clients);
+
+        result.is_valid = true;
+        result.messages_per_sec = static_cast<double>(messages) / options.seconds;
+        result.rss_per_connection = static_cast<double>(rss_after - rss_before) / opened;
+        return result;
+    }
+
+    Result run(const QString &backend, const Options &options)
+    {
+        Result result;
+        auto measure_echo = [&](const lb::CountConnections &count_connections)
+        {
+            result = measure(options, count_connections);
+        };
+        if(backend == "qt")
+        {
+            lb::run_qt_echo_server(options.port, measure_echo);
+        }
+        else
+        {
+            lb::run_epoll_echo_server(options.port, measure_echo);
+        }
+        return result;
+    }
+
+    void print(QTextStream &out, const QString &backend, const Options &options, const Result &result)
+    {
+        out << "{\"benchmark\":\"transport\",\"backend\":\"" << backend
+            << "\",\"valid\":" << (result.is_valid ? "true" : "false")
+            << ",\"connections\":" << options.connections
+            << ",\"message_size\":" << options.message_size
+            << ",\"seconds\":" << options.seconds
+            << ",\"messages_per_sec\":" << result.messages_per_sec
+            << ",\"rss_bytes_per_connection\":" << result.rss_per_connection
+            << "}" << endl;
+    }
+}
+
+int Benchmark::run_transport_benchmark(const QStringList &args)
+{
+    Options options;
+    if(args.size() > 0)
+    {
+        options.backend = args[0];
+    }
+    if(args.size() > 1)
+    {
+        options.connections = qMax(1, args[1].toInt());
+    }
+    if(args.size() > 2)
+    {
+        options.message_size = qMax(1, args[2].toInt());
+    }
+    if(args.size() > 3)
+    {
+        options.seconds = qMax(1, args[3].toInt());
+    }
+
+    lb::raise_descriptor_limit();
+    QTextStream out(stdout);
+    bool is_valid = true;
+
+    if(options.backend == "all" || options.backend == "qt")
+    {
+        Result result = run("qt", options);
+        print(out, "qt", options, result);
+        is_valid = is_valid && result.is_valid;
+        options.port++;
+    }
+    if(options.backend == "all" || options.backend == "epoll")
+    {
+        Result result = run("epoll", options);
+        print(out, "epoll", options, result);
+        is_valid = is_valid && result.is_valid;
+    }
+    return is_valid ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+#include "daemon.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QTextStream>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace dt = DataTransfer;
+namespace ao = ActiveObject;
+namespace dm = Daemon;
+
+namespace
+{
+    int signal_descriptors[2] = {-1, -1};
+
+#ifdef Q_OS_UNIX
+    void on_signal(int)
+    {
+        char value = 1;
+        ssize_t result = ::write(signal_descriptors[0], &value, sizeof(value));
+        Q_UNUSED(result);
+    }
+#endif
+}
+
+bool dm::Config::load(const QString &path)
+{
+    if(!QFileInfo(path).isReadable())
+    {
+        return false;
+    }
+
+    QSettings settings(path, QSettings::IniFormat);
+    if(settings.status() != QSettings::NoError)
+    {
+        return false;
+    }
+
+    addr = settings.value("server/address", addr).toString();
+    port = static_cast<quint16>(settings.value("server/port", port).toUInt());
+    max_connections = settings.value("server/max_connections", max_connections).toInt();
+    max_connections_per_address = settings.value("server/max_connections_per_address", max_connections_per_address).toInt();
+    idle_timeout = settings.value("server/idle_timeout_msec", idle_timeout).toInt();
+    heartbeat_timeout = settings.value("server/heartbeat_timeout_msec", heartbeat_timeout).toInt();
+    outbound_limit = settings.value("server/outbound_limit_bytes", outbound_limit).toLongLong();
+    count_threads = settings.value("scheduler/threads", count_threads).toUInt();
+    max_in_flight = settings.value("dispatcher/max_in_flight", max_in_flight).toInt();
+    is_ordered = settings.value("dispatcher/per_connection_order", is_ordered).toBool();
+    connection_name = settings.value("database/connection", connection_name).toString();
+    cache_entries = settings.value("database/cache_entries", cache_entries).toInt();
+    user_filter_fp_rate = settings.value("database/user_filter_fp_rate", user_filter_fp_rate).toDouble();
+    user_filter_max_bytes = settings.value("database/user_filter_max_bytes", user_filter_max_bytes).toLongLong();
+    storage_root = settings.value("storage/root", storage_root).toString();
+    chunk_store_root = settings.value("storage/chunk_store", chunk_store_root).toString();
+    unclaimed_grace_sec = settings.value("storage/unclaimed_grace_sec", unclaimed_grace_sec).toInt();
+    max_unclaimed_bytes = settings.value("storage/max_unclaimed_bytes", max_unclaimed_bytes).toLongLong();
+    is_watching = settings.value("storage/watch", is_watching).toBool();
+    watch_coalesce_msec = settings.value("storage/watch_coalesce_msec", watch_coalesce_msec).toInt();
+    return true;
+}
+
+// Self-pipe: the handler only writes a byte, the event loop does the shutdown.
+bool dm::ServerDaemon::watch_signals()
+{
+#ifdef Q_OS_UNIX
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, signal_descriptors) != 0)
+    {
+        return false;
+    }
+
+    struct sigaction action;
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+#else
+    return false;
+#endif
+}
+
+dm::ServerDaemon::ServerDaemon(const Config &config):
+    _config(config)
+{}
+
+dm::ServerDaemon::~ServerDaemon()
+{
+    stop();
+}
+
+bool dm::ServerDaemon::start()
+{
+    QTextStream err(stderr);
+
+    _data_base.reset(new DataBaseWork::WorkerServerDataBase(_config.connection_name));
+    if(!_data_base->is_ready())
+    {
+        err << "serverd: cannot open or upgrade the database" << endl;
+        return false;
+    }
+    _data_base->set_cache_size(_config.cache_entries);
+    if(_config.user_filter_fp_rate > 0 && !_data_base->enable_user_filter(_config.user_filter_fp_rate, _config.user_filter_max_bytes))
+    {
+        err << "serverd: cannot build the user filter" << endl;
+        return false;
+    }
+
+    unsigned int count_threads = _config.count_threads > 0 ? _config.count_threads
+                                                           : static_cast<unsigned int>(qMax(1, QThread::idealThreadCount()));
+    _workers.reset(new ao::ProxyActiveObject(count_threads));
+    if(!_workers->start())
+    {
+        err << "serverd: cannot start the scheduler" << endl;
+        return false;
+    }
+
+    _server.reset(new dt::BaseServer(_config.addr, _config.port));
+    if(_config.max_connections > 0)
+    {
+        _server->set_max_connections(_config.max_connections);
+    }
+    if(_config.max_connections_per_address > 0)
+    {
+        _server->set_max_connections_per_address(_config.max_connections_per_address);
+    }
+    if(_config.idle_timeout > 0)
+    {
+        _server->set_idle_timeout(_config.idle_timeout);
+    }
+    if(_config.heartbeat_timeout > 0)
+    {
+        _server->set_heartbeat_timeout(_config.heartbeat_timeout);
+    }
+    if(_config.outbound_limit > 0)
+    {
+        _server->set_outbound_limit(_config.outbound_limit);
+    }
+
+    _dispatcher.reset(new dt::RequestDispatcher(*_server, *_workers, _config.max_in_flight,
+                                                _config.is_ordered ? dt::RequestDispatcher::Ordering::PER_CONNECTION
+                                                                   : dt::RequestDispatcher::Ordering::OUT_OF_ORDER));
+
+    _transfer.reset(new Sync::ChunkedTransfer(_config.storage_root));
+    _transfer->register_handlers(*_dispatcher);
+    _delta.reset(new Sync::DeltaSync(_config.storage_root));
+    _delta->register_handlers(*_dispatcher);
+    _chunks.reset(new Sync::ChunkStore(_config.chunk_store_root));
+    if(!_chunks->open())
+    {
+        err << "serverd: cannot open chunk store " << _config.chunk_store_root << endl;
+        return false;
+    }
+    _chunks->set_unclaimed_limits(_config.unclaimed_grace_sec * 1000LL, _config.max_unclaimed_bytes);
+    _chunks->register_handlers(*_dispatcher);
+
+    _merkle.reset(new Sync::MerkleIndex());
+    DataBaseWork::WorkerServerDataBase::add_file_observer(_merkle.get());
+    _merkle->load(*_data_base);
+    _merkle->register_handlers(*_dispatcher);
+    _listing.reset(new Sync::FileListing(*_data_base));
+    _listing->register_handlers(*_dispatcher);
+
+#ifdef Q_OS_LINUX
+    if(_config.is_watching)
+    {
+        _watcher.reset(new Sync::FileWatcher(*_data_base, _config.watch_coalesce_msec));
+        if(!_watcher->start())
+        {
+            err << "serverd: cannot start the file watcher" << endl;
+            return false;
+        }
+        for (auto &user : _data_base->get_all_user())
+        {
+            _watcher->watch_user(user);
+            _watcher->rescan_user(user);
+        }
+        connect(_watcher.get(), &Sync::FileWatcher::files_changed, this, &ServerDaemon::notify_files_changed);
+        DataBaseWork::WorkerServerDataBase::add_file_observer(this);
+    }
+#endif
+
+    // Binds the connection to a user so it receives that user's
+    // FILES_CHANGED frames and shares the user's traffic limits. Only a
+    // connection from the address registered for the user may bind; an
+    // unregistered user has none and cannot be subscribed to.
+    _dispatcher->register_connection_handler(Sync::SUBSCRIBE_FILES, [this](QTcpSocket *socket, const QByteArray &request, QByteArray&)
+    {
+        QString user;
+        dt::Codec::Reader reader(request);
+        reader >> user;
+        if(!reader.is_valid() || !_data_base->is_user(user))
+        {
+            return false;
+        }
+        QHostAddress registered(_data_base->get_addr_info_user(user).first);
+        if(registered.isNull() || !registered.isEqual(socket->peerAddress(), QHostAddress::TolerantConversion))
+        {
+            return false;
+        }
+        _server->bind_user(socket, user);
+        return true;
+    });
+
+    connect(_server.get(), &dt::BaseServer::new_connection, _server.get(), &dt::BaseServer::add_connection);
+
+    if(!_server->run())
+    {
+        err << "serverd: cannot listen on " << _config.addr << ":" << _config.port << endl;
+        return false;
+    }
+
+    if(signal_descriptors[1] >= 0)
+    {
+        _signal_notifier.reset(new QSocketNotifier(signal_descriptors[1], QSocketNotifier::Read));
+        connect(_signal_notifier.get(), &QSocketNotifier::activated, this, &ServerDaemon::handle_signal);
+    }
+    return true;
+}
+
+void dm::ServerDaemon::stop()
+{
+    _signal_notifier.reset();
+#ifdef Q_OS_LINUX
+    if(_watcher)
+    {
+        DataBaseWork::WorkerServerDataBase::remove_file_observer(this);
+    }
+    _watcher.reset();
+#endif
+    if(_server)
+    {
+        _server->stop();
+    }
+    if(_workers)
+    {
+        _workers->wait();
+    }
+    _dispatcher.reset();
+    _transfer.reset();
+    _delta.reset();
+    _chunks.reset();
+    if(_merkle)
+    {
+        DataBaseWork::WorkerServerDataBase::remove_file_observer(_merkle.get());
+    }
+    _merkle.reset();
+    _listing.reset();
+    _server.reset();
+    _workers.reset();
+    _data_base.reset();
+}
+
+// Pushed unsolicited (request id 0) to every connection bound to the user.
+void dm::ServerDaemon::notify_files_changed(const QString &user, const QStringList &changed, const QStringList &removed)
+{
+    QByteArray payload = dt::Codec::encode(static_cast<quint32>(changed.size() + removed.size()));
+    for (auto &path : changed)
+    {
+        dt::Codec::append(payload, path, false);
+    }
+    for (auto &path : removed)
+    {
+        dt::Codec::append(payload, path, true);
+    }
+    _server->multicast_data(_server->get_user_sockets(user),
+                            dt::Protocol::encode_frame(0, Sync::FILES_CHANGED, dt::Protocol::REQUEST, payload));
+}
+
+// Observer calls arrive on whichever thread wrote the dirs; the watcher
+// belongs to the event loop thread.
+void dm::ServerDaemon::files_removed(const QString &user)
+{
+    QMetaObject::invokeMethod(this, [this, user]
+    {
+        if(_data_base && !_data_base->is_user(user))
+        {
+            rewatch_user(user);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void dm::ServerDaemon::dirs_changed(const QString &user)
+{
+    QMetaObject::invokeMethod(this, [this, user]{ rewatch_user(user); }, Qt::QueuedConnection);
+}
+
+// Dirs read back empty once the user or its dirs are gone, which drops the
+// watches; otherwise files created before the watch existed are caught up.
+void dm::ServerDaemon::rewatch_user(const QString &user)
+{
+#ifdef Q_OS_LINUX
+    if(!_watcher)
+    {
+        return;
+    }
+    if(_watcher->watch_user(user))
+    {
+        _watcher->rescan_user(user);
+    }
+    else
+    {
+        _watcher->unwatch_user(user);
+    }
+#else
+    Q_UNUSED(user);
+#endif
+}
+
+void dm::ServerDaemon::handle_signal()
+{
+#ifdef Q_OS_UNIX
+    char value;
+    ssize_t result = ::read(signal_descriptors[1], &value, sizeof(value));
+    Q_UNUSED(result);
+#endif
+    QCoreApplication::quit();
+}
@@ -0,0 +1,92 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <QObject>
+#include <QString>
+#include <QSocketNotifier>
+
+#include <memory>
+
+#include "BaseServer/base_server.h"
+#include "BaseServer/request_dispatcher.h"
+#include "ActiveObject/proxyactiveobject.h"
+#include "Workers/workerserverdatabase.h"
+#include "Sync/chunked_transfer.h"
+#include "Sync/delta_sync.h"
+#include "Sync/chunk_store.h"
+#include "Sync/merkle_tree.h"
+#include "Sync/file_listing.h"
+#ifdef Q_OS_LINUX
+#include "Sync/file_watcher.h"
+#endif
+
+namespace Daemon
+{
+    struct Config
+    {
+        QString addr = "0.0.0.0";
+        quint16 port = 5555;
+        int max_connections = 0;
+        int max_connections_per_address = 0;
+        int idle_timeout = 0;
+        int heartbeat_timeout = 0;
+        qint64 outbound_limit = 0;
+        unsigned int count_threads = 0;
+        int max_in_flight = 64;
+        bool is_ordered = false;
+        QString connection_name = "db_connection_daemon";
+        int cache_entries = 0;
+        double user_filter_fp_rate = 0.01;
+        qint64 user_filter_max_bytes = 0;
+        QString storage_root = "storage";
+        QString chunk_store_root = "chunks";
+        int unclaimed_grace_sec = 3600;
+        qint64 max_unclaimed_bytes = 1024LL * 1024 * 1024;
+        bool is_watching = true;
+        int watch_coalesce_msec = 200;
+
+        bool load(const QString &path);
+    };
+
+    class ServerDaemon : public QObject, public DataBaseWork::WorkerServerDataBase::FileObserver
+    {
+        Q_OBJECT
+
+    public:
+        explicit ServerDaemon(const Config &config);
+        ServerDaemon(const ServerDaemon&) = delete;
+        ServerDaemon(const ServerDaemon&&) = delete;
+        ServerDaemon& operator=(const ServerDaemon&) = delete;
+        ServerDaemon& operator=(const ServerDaemon&&) = delete;
+        virtual ~ServerDaemon();
+
+        bool start();
+        void stop();
+
+        static bool watch_signals();
+
+    private:
+        void handle_signal();
+        void files_removed(const QString &user) override;
+        void dirs_changed(const QString &user) override;
+        void rewatch_user(const QString &user);
+        void notify_files_changed(const QString &user, const QStringList &changed, const QStringList &removed);
+
+        Config _config;
+        std::unique_ptr<ActiveObject::ProxyActiveObject> _workers;
+        std::unique_ptr<DataBaseWork::WorkerServerDataBase> _data_base;
+        std::unique_ptr<DataTransfer::BaseServer> _server;
+        std::unique_ptr<DataTransfer::RequestDispatcher> _dispatcher;
+        std::unique_ptr<Sync::ChunkedTransfer> _transfer;
+        std::unique_ptr<Sync::DeltaSync> _delta;
+        std::unique_ptr<Sync::ChunkStore> _chunks;
+        std::unique_ptr<Sync::MerkleIndex> _merkle;
+        std::unique_ptr<Sync::FileListing> _listing;
+        std::unique_ptr<QSocketNotifier> _signal_notifier;
+#ifdef Q_OS_LINUX
+        std::unique_ptr<Sync::FileWatcher> _watcher;
+#endif
+    };
+}
+
+#endif // DAEMON_H
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Headless server without QtWidgets
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = serverd
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+CONFIG += c++11, c++14
+
+include(../server/server_core.pri)
+
+SOURCES += \
+        main.cpp \
+    daemon.cpp
+
+HEADERS += \
+    daemon.h
+
+DISTFILES += \
+    serverd.ini
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
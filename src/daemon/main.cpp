@@ -0,0 +1,34 @@
+#include "daemon.h"
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QDir>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments().mid(1);
+    QString path = args.isEmpty() ? QDir(a.applicationDirPath()).filePath("serverd.ini") : args.first();
+
+    Daemon::Config config;
+    if(!config.load(path))
+    {
+        if(!args.isEmpty())
+        {
+            QTextStream(stderr) << "serverd: cannot read config " << path << endl;
+            return 1;
+        }
+        QTextStream(stderr) << "serverd: " << path << " not found, using defaults" << endl;
+    }
+
+    Daemon::ServerDaemon::watch_signals();
+    Daemon::ServerDaemon server_daemon(config);
+    if(!server_daemon.start())
+    {
+        return 1;
+    }
+
+    int result = a.exec();
+    server_daemon.stop();
+    return result;
+}
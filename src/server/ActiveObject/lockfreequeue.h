@@ -0,0 +1,68 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace ActiveObject
+{
+    // Unbounded multi-producer single-consumer queue: push() may be called from
+    // any thread, pop() only from the owning thread.
+    template<typename T>
+    class LockFreeQueue
+    {
+    public:
+        LockFreeQueue():
+            _head(new Node),
+            _tail(_head.load())
+        {}
+
+        LockFreeQueue(const LockFreeQueue&) = delete;
+        LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+        virtual ~LockFreeQueue()
+        {
+            T value;
+            while(pop(value));
+            delete _tail;
+        }
+
+        void push(T value)
+        {
+            Node *node = new Node;
+            node->value = std::move(value);
+            Node *previous = _head.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        bool pop(T &value)
+        {
+            Node *next = _tail->next.load(std::memory_order_acquire);
+            if(!next)
+            {
+                return false;
+            }
+            value = std::move(next->value);
+            delete _tail;
+            _tail = next;
+            return true;
+        }
+
+        bool is_empty()const
+        {
+            return _tail->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        struct Node
+        {
+            std::atomic<Node*> next{nullptr};
+            T value;
+        };
+
+        std::atomic<Node*> _head;
+        Node *_tail;
+    };
+}
+
+#endif // LOCKFREEQUEUE_H
@@ -3,6 +3,8 @@
 
 namespace AO = ActiveObject;
 
+constexpr std::chrono::milliseconds AO::Scheduler::IDLE_WAIT;
+
 AO::AbstractTask* AO::Scheduler::pop_task()
 {
     refresh_queue();
@@ -18,16 +20,22 @@ AO::AbstractTask* AO::Scheduler::pop_task()
 
 unsigned int AO::Scheduler::push_task(AbstractTask *task)
 {
-    std::lock_guard<std::mutex> guard(_access_to_queue);
+    std::unique_lock<std::mutex> guard(_access_to_queue);
     _queue_tasks.push_back(std::make_tuple(_index,task));
-    return _index++;
+    unsigned int index = _index++;
+    guard.unlock();
+    _has_task.notify_one();
+    return index;
 }
 
 unsigned int AO::Scheduler::push_task(AbstractTask *task, int msec, TypeTask type)
 {
-    std::lock_guard<std::mutex> guard(_access_to_deffered_queue);
+    std::unique_lock<std::mutex> guard(_access_to_deffered_queue);
     _queue_deffered_tasks.push_back(std::make_tuple(_index,task,type,msec,steady_clk::now()));
-    return _index++;
+    unsigned int index = _index++;
+    guard.unlock();
+    _has_task.notify_one();
+    return index;
 }
 
 void AO::Scheduler::refresh_queue()
@@ -102,6 +110,7 @@ bool AO::Scheduler::remove_task(unsigned int index)
 void AO::Scheduler::wait_all()
 {
     _is_run = false;
+    _has_task.notify_all();
     for (unsigned int i = 0; i < _count_thread; i++)
     {
         if(_threads[i].joinable())
@@ -126,6 +135,12 @@ bool AO::Scheduler::run_all()
             if(task)
             {
                 task->run_process();
+                delete task;
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(_access_to_queue);
+                _has_task.wait_for(lock, IDLE_WAIT, [this]{ return !_queue_tasks.empty() || !_is_run; });
             }
         }
     };
@@ -9,6 +9,7 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
 
 namespace ActiveObject
@@ -31,6 +32,7 @@ namespace ActiveObject
 
     private:
         static constexpr unsigned int DEFAULT_THREAD = 1;
+        static constexpr std::chrono::milliseconds IDLE_WAIT{1};
 
         using steady_clk = std::chrono::steady_clock;
         using tm_point = std::chrono::time_point<steady_clk>;
@@ -49,6 +51,7 @@ namespace ActiveObject
         std::vector<std::thread> _threads;
         std::mutex _access_to_queue;
         std::mutex _access_to_deffered_queue;
+        std::condition_variable _has_task;
 
         unsigned int _index;
         unsigned int _count_thread;
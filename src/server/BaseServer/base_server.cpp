@@ -6,9 +6,25 @@ dt::BaseServer::BaseServer(const QString &addr,quint16 port) :
     _addr(addr),
     _port(port),
     _mutex(nullptr),
-    _wait_for_bytes_written(0)
+    _wait_for_bytes_written(0),
+    _outbound_limit(DEFAULT_OUTBOUND_LIMIT),
+    _last_connection_id(0),
+    _max_connections(0),
+    _max_connections_per_address(0),
+    _idle_timeout(0),
+    _heartbeat_timeout(0)
 {
      connect(&_server,&QTcpServer::newConnection,this,&BaseServer::new_connection);
+     connect(&_reaper,&QTimer::timeout,this,&BaseServer::reap_connections);
+     connect(&_outbound_timer,&QTimer::timeout,this,[this]()
+     {
+         QMutexLocker lock(_mutex);
+         schedule_outbound();
+     });
+     connect(&_inbound_timer,&QTimer::timeout,this,&BaseServer::resume_reads);
+     _outbound_timer.setSingleShot(true);
+     _inbound_timer.setSingleShot(true);
+     _clock.start();
 }
 
 bool dt::BaseServer::run()
@@ -29,6 +45,7 @@ void dt::BaseServer::stop()
         remove_connection(item);
     }
     _server.close();
+    _timeouts.clear();
 }
 
 QVector<QPair<QString,quint16>> dt::BaseServer::info_connection()
@@ -42,6 +59,58 @@ QVector<QPair<QString,quint16>> dt::BaseServer::info_connection()
     return data;
 }
 
+QVector<dt::ConnectionStatsSnapshot> dt::BaseServer::connection_stats() const
+{
+    QMutexLocker lock(_mutex);
+    QVector<ConnectionStatsSnapshot> data;
+    data.reserve(_contexts.size());
+    for (auto &connection : _contexts)
+    {
+        data.push_back(ConnectionStatsSnapshot());
+        fill_stats(*connection, data.last());
+    }
+    return data;
+}
+
+bool dt::BaseServer::connection_stats(QTcpSocket *socket, ConnectionStatsSnapshot &snapshot) const
+{
+    QMutexLocker lock(_mutex);
+    auto connection = context(socket);
+    if(!connection)
+    {
+        return false;
+    }
+    fill_stats(*connection, snapshot);
+    return true;
+}
+
+void dt::BaseServer::fill_stats(const ConnectionContext &connection, ConnectionStatsSnapshot &snapshot) const
+{
+    snapshot.id = connection.id;
+    snapshot.address = connection.address;
+    snapshot.port = connection.port;
+    snapshot.user = connection.user;
+    connection.stats.fill(snapshot, _clock.elapsed());
+}
+
+void dt::BaseServer::record_latency(QTcpSocket *socket, qint64 usec)
+{
+    if(auto connection = context(socket))
+    {
+        connection->stats.add_latency(usec);
+    }
+}
+
+// Reads carry no message boundaries; whoever parses the stream reports each
+// message it takes off it.
+void dt::BaseServer::record_inbound_message(QTcpSocket *socket)
+{
+    if(auto connection = context(socket))
+    {
+        connection->stats.add_inbound_message();
+    }
+}
+
 void dt::BaseServer::remove_connection(int index)
 {
     QMutexLocker lock(_mutex);
@@ -51,6 +120,7 @@ void dt::BaseServer::remove_connection(int index)
         {
             _sockets_mutexes.remove(_sockets[index]);
         }
+        release_context(_sockets[index]);
         _sockets[index]->disconnectFromHost();
         _sockets[index]->deleteLater();
         _sockets.removeAt(index);
@@ -66,6 +136,7 @@ void dt::BaseServer::remove_connection(QTcpSocket *socket)
         {
             _sockets_mutexes.remove(socket);
         }
+        release_context(socket);
         socket->disconnectFromHost();
         socket->deleteLater();
         _sockets.removeOne(socket);
@@ -75,14 +146,63 @@ void dt::BaseServer::remove_connection(QTcpSocket *socket)
 void dt::BaseServer::add_connection()
 {
     QMutexLocker lock(_mutex);
+    if(_max_connections > 0 && _contexts.size() >= _max_connections)
+    {
+        _server.pauseAccepting();
+        return;
+    }
     if(_server.hasPendingConnections())
     {
         QTcpSocket *client = _server.nextPendingConnection();
+        QString address = client->peerAddress().toString();
+        if(_max_connections_per_address > 0 && _address_counts.value(address) >= _max_connections_per_address)
+        {
+            client->abort();
+            client->deleteLater();
+            emit connection_rejected(address);
+            return;
+        }
+
+        auto connection = QSharedPointer<ConnectionContext>::create();
+        connection->id = ++_last_connection_id;
+        connection->address = address;
+        connection->port = client->peerPort();
+        connection->last_inbound = connection->last_activity = _clock.elapsed();
+        connection->stats.touch(connection->last_activity);
+        connection->limits = _connection_limits;
+        if(_connection_limits.inbound_bytes.is_limited() || _user_limits.inbound_bytes.is_limited())
+        {
+            client->setReadBufferSize(LIMITED_READ_BUFFER_SIZE);
+        }
+
         _sockets.push_back(client);
+        _contexts.insert(client, connection);
+        _address_counts[address]++;
+        schedule_timeout(client, *connection);
+
+        if(_max_connections > 0 && _contexts.size() >= _max_connections)
+        {
+            _server.pauseAccepting();
+        }
 
         connect(client, &QTcpSocket::readyRead,
-        [socket = _sockets.last(),this]()
+        [socket = _sockets.last(),weak_connection = connection.toWeakRef(),this]()
         {
+            if(auto connection = weak_connection.toStrongRef())
+            {
+                qint64 now = _clock.elapsed();
+                connection->last_inbound = connection->last_activity = now;
+                if(connection->is_read_paused)
+                {
+                    return;
+                }
+                qint64 delay = traffic_delay(*connection, Direction::INBOUND, 1, now);
+                if(delay > 0)
+                {
+                    pause_read(socket, *connection, delay);
+                    return;
+                }
+            }
             emit ready_data_read(socket);
         });
 
@@ -92,6 +212,26 @@ void dt::BaseServer::add_connection()
             emit socket_error(socket,error);
         });
 
+        // A socket with room again gets its share in a full DRR pass, so
+        // a fast reader cannot refill ahead of the other queued connections.
+        connect(client, &QTcpSocket::bytesWritten,
+        [socket = _sockets.last(),weak_connection = connection.toWeakRef(),this](qint64)
+        {
+            QMutexLocker lock(_mutex);
+            auto connection = weak_connection.toStrongRef();
+            if(!connection)
+            {
+                return;
+            }
+            qint64 now = _clock.elapsed();
+            connection->last_activity = now;
+            connection->stats.set_queued(connection->outbound_bytes + socket->bytesToWrite());
+            if(connection->is_active)
+            {
+                schedule_outbound();
+            }
+        });
+
         connect(client, &QTcpSocket::disconnected,
         [socket = _sockets.last(),this]()
         {
@@ -105,49 +245,550 @@ void dt::BaseServer::add_connection()
     }
 }
 
+// Goes through the same queue as queue_data(), so the rate limits and DRR
+// apply. With wait_for_bytes_written set it runs the DRR pass itself and
+// waits for whatever reached the socket; data held back by a rate limit
+// stays queued.
 bool dt::BaseServer::write_data(QTcpSocket *socket, QByteArray &data)
+{
+    if(!is_valid_socket(socket) || !queue_data(socket, data))
+    {
+        return false;
+    }
+    if(!_wait_for_bytes_written)
+    {
+        return true;
+    }
+    {
+        QMutexLocker lock(_mutex);
+        schedule_outbound();
+    }
+    return !socket->bytesToWrite() || socket->waitForBytesWritten(_wait_for_bytes_written);
+}
+
+bool dt::BaseServer::write_data(int index, QByteArray &data)
+{
+    if(!(index >= 0 && index < _sockets.size()))
+    {
+        return false;
+    }
+    return write_data(_sockets[index], data);
+}
+
+bool dt::BaseServer::read_data(QTcpSocket *socket, QByteArray &data)
 {
     bool is_thread_safe = _sockets_mutexes.find(socket) != _sockets_mutexes.end();
     QMutexLocker lock(is_thread_safe ? _sockets_mutexes[socket].get() : nullptr);
 
-    if(is_valid_socket(socket)  && !data.isEmpty())
+    while(is_valid_socket(socket) && socket->bytesAvailable())
     {
-        socket->write(data);
-        return _wait_for_bytes_written ? socket->waitForBytesWritten(_wait_for_bytes_written) : true;
+        data = socket->readAll();
+        if(auto connection = context(socket))
+        {
+            qint64 now = _clock.elapsed();
+            consume_traffic(*connection, Direction::INBOUND, data.size(), now);
+            connection->stats.add_inbound(data.size(), now);
+        }
+        return true;
     }
     return false;
 }
 
-bool dt::BaseServer::write_data(int index, QByteArray &data)
+int dt::BaseServer::broadcast_data(const QByteArray &data, SlowClientPolicy policy)
 {
-    if(!(index >= 0 && index < _sockets.size()))
+    return multicast_data(_sockets, data, policy);
+}
+
+int dt::BaseServer::multicast_data(const QList<QTcpSocket*> &sockets, const QByteArray &data, SlowClientPolicy policy)
+{
+    QMutexLocker lock(_mutex);
+    if(data.isEmpty())
+    {
+        return 0;
+    }
+
+    int count = 0;
+    QList<QTcpSocket*> slow_clients;
+    for (auto socket : sockets)
+    {
+        auto connection = context(socket);
+        if(!connection || socket->state() != QAbstractSocket::ConnectedState)
+        {
+            continue;
+        }
+        if(enqueue_data(socket, *connection, data, policy))
+        {
+            count++;
+        }
+        else if(policy == SlowClientPolicy::DROP)
+        {
+            slow_clients.push_back(socket);
+        }
+    }
+
+    for (auto socket : slow_clients)
+    {
+        remove_connection(socket);
+    }
+    arm_outbound_timer(0);
+    return count;
+}
+
+bool dt::BaseServer::queue_data(QTcpSocket *socket, const QByteArray &data)
+{
+    QMutexLocker lock(_mutex);
+    auto connection = context(socket);
+    if(!connection || data.isEmpty() || socket->state() != QAbstractSocket::ConnectedState)
     {
         return false;
     }
-    auto socket = _sockets[index];
+    enqueue_data(socket, *connection, data, SlowClientPolicy::QUEUE);
+    arm_outbound_timer(0);
+    return true;
+}
 
+bool dt::BaseServer::enqueue_data(QTcpSocket *socket, ConnectionContext &connection, const QByteArray &data, SlowClientPolicy policy)
+{
     bool is_thread_safe = _sockets_mutexes.find(socket) != _sockets_mutexes.end();
     QMutexLocker lock(is_thread_safe ? _sockets_mutexes[socket].get() : nullptr);
 
-    if(is_valid_socket(socket)  && !data.isEmpty())
+    if(policy != SlowClientPolicy::QUEUE
+            && connection.outbound_bytes + socket->bytesToWrite() > _outbound_limit)
+    {
+        return false;
+    }
+
+    connection.outbound.enqueue(data);
+    connection.outbound_bytes += data.size();
+    connection.stats.set_queued(connection.outbound_bytes + socket->bytesToWrite());
+    activate_outbound(socket, connection);
+    return true;
+}
+
+void dt::BaseServer::activate_outbound(QTcpSocket *socket, ConnectionContext &connection)
+{
+    if(!connection.is_active)
     {
+        connection.is_active = true;
+        _active_outbound.push_back(socket);
+    }
+}
+
+// Deficit round robin over the connections with queued data: each turn a
+// connection may send up to DRR_QUANTUM bytes (plus its saved deficit), so a
+// large transfer cannot hold the uplink while small clients wait.
+void dt::BaseServer::schedule_outbound()
+{
+    qint64 now = _clock.elapsed();
+    qint64 delay = -1;
+    bool is_progress = true;
+
+    while(is_progress && !_active_outbound.isEmpty())
+    {
+        is_progress = false;
+        for (int i = 0; i < _active_outbound.size();)
+        {
+            QTcpSocket *socket = _active_outbound[i];
+            auto connection = context(socket);
+            if(!connection || !service_outbound(socket, *connection, now, delay, is_progress))
+            {
+                if(connection)
+                {
+                    connection->is_active = false;
+                }
+                _active_outbound.removeAt(i);
+                continue;
+            }
+            i++;
+        }
+    }
+    arm_outbound_timer(delay);
+}
+
+// One DRR turn for one connection. Returns false once its queue is empty;
+// the caller takes it off the active list.
+bool dt::BaseServer::service_outbound(QTcpSocket *socket, ConnectionContext &connection, qint64 now, qint64 &delay, bool &is_progress)
+{
+    bool is_thread_safe = _sockets_mutexes.find(socket) != _sockets_mutexes.end();
+    QMutexLocker lock(is_thread_safe ? _sockets_mutexes[socket].get() : nullptr);
+
+    bool is_sent = false;
+    bool is_blocked = false;
+    connection.deficit += DRR_QUANTUM;
+    while(!connection.outbound.isEmpty())
+    {
+        qint64 size = connection.outbound.head().size();
+        if(size > connection.deficit)
+        {
+            is_progress = true;
+            break;
+        }
+        qint64 wait = traffic_delay(connection, Direction::OUTBOUND, size, now);
+        if(wait > 0 || socket->bytesToWrite() >= SOCKET_BUFFER_THRESHOLD)
+        {
+            if(wait > 0)
+            {
+                delay = delay < 0 ? wait : qMin(delay, wait);
+            }
+            is_blocked = true;
+            break;
+        }
+
+        QByteArray data = connection.outbound.dequeue();
+        connection.outbound_bytes -= size;
+        connection.deficit -= size;
+        consume_traffic(connection, Direction::OUTBOUND, size, now);
         socket->write(data);
-        return _wait_for_bytes_written ? socket->waitForBytesWritten(_wait_for_bytes_written) : true;
+        connection.stats.add_outbound(size, now);
+        is_sent = true;
+        is_progress = true;
     }
-    return false;
+
+    connection.stats.set_queued(connection.outbound_bytes + socket->bytesToWrite());
+    if(is_blocked && !is_sent)
+    {
+        connection.deficit -= DRR_QUANTUM;
+    }
+    if(connection.outbound.isEmpty())
+    {
+        connection.deficit = 0;
+        return false;
+    }
+    return true;
 }
 
-bool dt::BaseServer::read_data(QTcpSocket *socket, QByteArray &data)
+// A delay of 0 runs schedule_outbound() on the next pass of the event loop,
+// so a burst of queue_data() calls is sent in one DRR pass.
+void dt::BaseServer::arm_outbound_timer(qint64 delay)
+{
+    if(delay >= 0 && (!_outbound_timer.isActive() || _outbound_timer.remainingTime() > delay))
+    {
+        _outbound_timer.start(static_cast<int>(delay));
+    }
+}
+
+qint64 dt::BaseServer::traffic_delay(ConnectionContext &connection, Direction direction, qint64 bytes, qint64 now)
+{
+    qint64 delay = 0;
+    for (TrafficLimits *limits : {&connection.limits, connection.user_limits.data()})
+    {
+        if(!limits)
+        {
+            continue;
+        }
+        TokenBucket &bytes_bucket = direction == Direction::INBOUND ? limits->inbound_bytes : limits->outbound_bytes;
+        TokenBucket &messages_bucket = direction == Direction::INBOUND ? limits->inbound_messages : limits->outbound_messages;
+        delay = qMax(delay, qMax(bytes_bucket.delay_msec(bytes, now), messages_bucket.delay_msec(1, now)));
+    }
+    return delay;
+}
+
+void dt::BaseServer::consume_traffic(ConnectionContext &connection, Direction direction, qint64 bytes, qint64 now)
+{
+    for (TrafficLimits *limits : {&connection.limits, connection.user_limits.data()})
+    {
+        if(!limits)
+        {
+            continue;
+        }
+        TokenBucket &bytes_bucket = direction == Direction::INBOUND ? limits->inbound_bytes : limits->outbound_bytes;
+        TokenBucket &messages_bucket = direction == Direction::INBOUND ? limits->inbound_messages : limits->outbound_messages;
+        bytes_bucket.consume(bytes, now);
+        messages_bucket.consume(1, now);
+    }
+}
+
+void dt::BaseServer::pause_read(QTcpSocket *socket, ConnectionContext &connection, qint64 delay)
+{
+    connection.is_read_paused = true;
+    _paused_reads.push_back(socket);
+    if(!_inbound_timer.isActive() || _inbound_timer.remainingTime() > delay)
+    {
+        _inbound_timer.start(static_cast<int>(delay));
+    }
+}
+
+void dt::BaseServer::resume_reads()
+{
+    qint64 now = _clock.elapsed();
+    qint64 delay = -1;
+    QList<QTcpSocket*> ready;
+
+    for (int i = 0; i < _paused_reads.size();)
+    {
+        QTcpSocket *socket = _paused_reads[i];
+        auto connection = context(socket);
+        if(!connection)
+        {
+            _paused_reads.removeAt(i);
+            continue;
+        }
+        qint64 wait = traffic_delay(*connection, Direction::INBOUND, 1, now);
+        if(wait > 0)
+        {
+            delay = delay < 0 ? wait : qMin(delay, wait);
+            i++;
+            continue;
+        }
+        connection->is_read_paused = false;
+        _paused_reads.removeAt(i);
+        ready.push_back(socket);
+    }
+
+    if(delay > 0)
+    {
+        _inbound_timer.start(static_cast<int>(delay));
+    }
+    for (auto socket : ready)
+    {
+        if(socket->bytesAvailable())
+        {
+            emit ready_data_read(socket);
+        }
+    }
+}
+
+void dt::BaseServer::bind_user(QTcpSocket *socket, const QString &user)
+{
+    QMutexLocker lock(_mutex);
+    auto connection = context(socket);
+    if(!connection)
+    {
+        return;
+    }
+
+    auto limits = _users_limits.value(user).toStrongRef();
+    if(!limits)
+    {
+        limits = QSharedPointer<TrafficLimits>::create(_user_limits);
+        _users_limits.insert(user, limits.toWeakRef());
+    }
+    connection->user = user;
+    connection->user_limits = limits;
+}
+
+void dt::BaseServer::set_connection_rate_limit(Direction direction, qint64 bytes_per_sec, qint64 messages_per_sec)
+{
+    QMutexLocker lock(_mutex);
+    auto apply = [&](TrafficLimits &limits)
+    {
+        if(direction == Direction::INBOUND)
+        {
+            limits.inbound_bytes.set_rate(bytes_per_sec);
+            limits.inbound_messages.set_rate(messages_per_sec);
+        }
+        else
+        {
+            limits.outbound_bytes.set_rate(bytes_per_sec);
+            limits.outbound_messages.set_rate(messages_per_sec);
+        }
+    };
+
+    apply(_connection_limits);
+    for (auto &connection : _contexts)
+    {
+        apply(connection->limits);
+    }
+}
+
+void dt::BaseServer::set_user_rate_limit(Direction direction, qint64 bytes_per_sec, qint64 messages_per_sec)
+{
+    QMutexLocker lock(_mutex);
+    auto apply = [&](TrafficLimits &limits)
+    {
+        if(direction == Direction::INBOUND)
+        {
+            limits.inbound_bytes.set_rate(bytes_per_sec);
+            limits.inbound_messages.set_rate(messages_per_sec);
+        }
+        else
+        {
+            limits.outbound_bytes.set_rate(bytes_per_sec);
+            limits.outbound_messages.set_rate(messages_per_sec);
+        }
+    };
+
+    apply(_user_limits);
+    for (auto &limits : _users_limits)
+    {
+        if(auto user_limits = limits.toStrongRef())
+        {
+            apply(*user_limits);
+        }
+    }
+}
+
+void dt::BaseServer::release_context(QTcpSocket *socket)
+{
+    auto connection = _contexts.take(socket);
+    if(!connection)
+    {
+        return;
+    }
+
+    auto it = _address_counts.find(connection->address);
+    if(it != _address_counts.end() && --it.value() <= 0)
+    {
+        _address_counts.erase(it);
+    }
+
+    if(_max_connections > 0 && _contexts.size() < _max_connections && _server.isListening())
+    {
+        _server.resumeAccepting();
+        if(_server.hasPendingConnections())
+        {
+            QMetaObject::invokeMethod(this, "new_connection", Qt::QueuedConnection);
+        }
+    }
+}
+
+// A connection already in the wheel is only moved when its deadline comes
+// earlier, e.g. after a timeout was shortened; the superseded entry is
+// dropped when its slot comes up. Later deadlines are picked up lazily.
+void dt::BaseServer::schedule_timeout(QTcpSocket *socket, ConnectionContext &connection)
+{
+    qint64 deadline = next_deadline(connection);
+    if(deadline < 0 || (connection.is_scheduled && deadline >= connection.scheduled_deadline))
+    {
+        return;
+    }
+    connection.is_scheduled = true;
+    connection.scheduled_deadline = deadline;
+    _timeouts.schedule({socket, connection.id, ++connection.timeout_generation}, deadline);
+}
+
+qint64 dt::BaseServer::next_deadline(const ConnectionContext &connection) const
+{
+    qint64 deadline = -1;
+    if(_idle_timeout > 0)
+    {
+        deadline = connection.last_activity + _idle_timeout;
+    }
+    if(_heartbeat_timeout > 0)
+    {
+        qint64 heartbeat = connection.last_inbound + _heartbeat_timeout;
+        deadline = deadline < 0 ? heartbeat : qMin(deadline, heartbeat);
+    }
+    return deadline;
+}
+
+void dt::BaseServer::update_reaper()
+{
+    if(_idle_timeout <= 0 && _heartbeat_timeout <= 0)
+    {
+        _reaper.stop();
+        return;
+    }
+    for (auto it = _contexts.begin(); it != _contexts.end(); it++)
+    {
+        schedule_timeout(it.key(), *it.value());
+    }
+    if(!_reaper.isActive())
+    {
+        _reaper.start(static_cast<int>(_timeouts.tick_msec()));
+    }
+}
+
+void dt::BaseServer::reap_connections()
+{
+    QMutexLocker lock(_mutex);
+    qint64 now = _clock.elapsed();
+    QList<QTcpSocket*> expired;
+
+    _timeouts.advance(now, [&](const TimeoutEntry &entry) -> qint64
+    {
+        auto connection = _contexts.value(entry.socket);
+        if(!connection || connection->id != entry.id || connection->timeout_generation != entry.generation)
+        {
+            return -1;
+        }
+        qint64 deadline = next_deadline(*connection);
+        if(deadline < 0 || deadline <= now)
+        {
+            connection->is_scheduled = false;
+            if(deadline >= 0)
+            {
+                expired.push_back(entry.socket);
+            }
+            return -1;
+        }
+        connection->scheduled_deadline = deadline;
+        return deadline;
+    });
+
+    for (auto socket : expired)
+    {
+        emit connection_timeout(socket);
+        remove_connection(socket);
+    }
+}
+
+void dt::BaseServer::set_idle_timeout(int msec)
+{
+    _idle_timeout = msec;
+    update_reaper();
+}
+
+void dt::BaseServer::set_heartbeat_timeout(int msec)
+{
+    _heartbeat_timeout = msec;
+    update_reaper();
+}
+
+void dt::BaseServer::set_max_connections(int count)
+{
+    _max_connections = count;
+}
+
+void dt::BaseServer::set_max_connections_per_address(int count)
+{
+    _max_connections_per_address = count;
+}
+
+void dt::BaseServer::set_outbound_limit(qint64 bytes)
+{
+    _outbound_limit = bytes;
+}
+
+bool dt::BaseServer::read_data(QTcpSocket *socket, BufferSlice &data)
 {
     bool is_thread_safe = _sockets_mutexes.find(socket) != _sockets_mutexes.end();
     QMutexLocker lock(is_thread_safe ? _sockets_mutexes[socket].get() : nullptr);
 
-    while(is_valid_socket(socket) && socket->bytesAvailable())
+    auto connection = context(socket);
+    if(!connection || !is_valid_socket(socket) || !socket->bytesAvailable())
     {
-        data = socket->readAll();
-        return true;
+        return false;
     }
-    return false;
+
+    if(connection->read_block.is_empty() || connection->read_offset >= BufferSlice::BLOCK_SIZE)
+    {
+        connection->read_block = BufferSlice::allocate();
+        connection->read_offset = 0;
+    }
+
+    qint64 size = socket->read(connection->read_block.data() + connection->read_offset,
+                               BufferSlice::BLOCK_SIZE - connection->read_offset);
+    if(size <= 0)
+    {
+        return false;
+    }
+
+    data = connection->read_block.mid(connection->read_offset, static_cast<int>(size));
+    connection->read_offset += static_cast<int>(size);
+    if(!socket->bytesAvailable())
+    {
+        connection->read_block.clear();
+    }
+    qint64 now = _clock.elapsed();
+    consume_traffic(*connection, Direction::INBOUND, size, now);
+    connection->stats.add_inbound(size, now);
+    return true;
+}
+
+QSharedPointer<dt::ConnectionContext> dt::BaseServer::context(QTcpSocket *socket) const
+{
+    return _contexts.value(socket);
 }
 
 bool dt::BaseServer::is_valid_socket(QTcpSocket *socket) const
@@ -179,6 +820,21 @@ QList<QTcpSocket*> dt::BaseServer::get_client_sockets() const
     return _sockets;
 }
 
+QList<QTcpSocket*> dt::BaseServer::get_user_sockets(const QString &user) const
+{
+    QMutexLocker lock(_mutex);
+    QList<QTcpSocket*> sockets;
+    for (auto socket : _sockets)
+    {
+        auto connection = context(socket);
+        if(connection && connection->user == user)
+        {
+            sockets.append(socket);
+        }
+    }
+    return sockets;
+}
+
 dt::BaseServer::~BaseServer()
 {
 
@@ -6,11 +6,18 @@
 #include <QTcpSocket>
 #include <QMutex>
 #include <QMap>
+#include <QHash>
 #include <QVector>
 #include <QPair>
 #include <QSharedPointer>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QDataStream>
 
+#include "codec.h"
+#include "connection_context.h"
+#include "timing_wheel.h"
+
 namespace DataTransfer
 {
     class BaseServer : public QObject
@@ -22,8 +29,13 @@ namespace DataTransfer
         void socket_error(QTcpSocket *socket, QAbstractSocket::SocketError state);
         void ready_data_read(QTcpSocket *socket);
         void disconnected_socket(QTcpSocket *socket);
+        void connection_timeout(QTcpSocket *socket);
+        void connection_rejected(const QString &addr);
 
     public:
+        enum class SlowClientPolicy {QUEUE = 0, SKIP, DROP};
+        enum class Direction {INBOUND = 0, OUTBOUND};
+
         BaseServer(const QString &addr,quint16 port);
         BaseServer(const BaseServer&) = delete;
         BaseServer(const BaseServer&&) = delete;
@@ -39,46 +51,110 @@ namespace DataTransfer
         void remove_connection(QTcpSocket *socket);
 
         QVector<QPair<QString,quint16>> info_connection();
+        QVector<ConnectionStatsSnapshot> connection_stats() const;
+        bool connection_stats(QTcpSocket *socket, ConnectionStatsSnapshot &snapshot) const;
+        void record_latency(QTcpSocket *socket, qint64 usec);
+        void record_inbound_message(QTcpSocket *socket);
 
         QList<QTcpSocket*> get_client_sockets() const;
+        QList<QTcpSocket*> get_user_sockets(const QString &user) const;
 
         bool write_data(QTcpSocket *socket, QByteArray &data);
         bool write_data(int index, QByteArray &data);
         bool read_data(QTcpSocket *socket, QByteArray &data);
+        bool read_data(QTcpSocket *socket, BufferSlice &data);
+
+        int broadcast_data(const QByteArray &data, SlowClientPolicy policy = SlowClientPolicy::SKIP);
+        int multicast_data(const QList<QTcpSocket*> &sockets, const QByteArray &data,
+                           SlowClientPolicy policy = SlowClientPolicy::SKIP);
+        bool queue_data(QTcpSocket *socket, const QByteArray &data);
+        void set_outbound_limit(qint64 bytes);
+
+        void bind_user(QTcpSocket *socket, const QString &user);
+        void set_connection_rate_limit(Direction direction, qint64 bytes_per_sec, qint64 messages_per_sec);
+        void set_user_rate_limit(Direction direction, qint64 bytes_per_sec, qint64 messages_per_sec);
 
         void set_mutex(QMutex *mutex);
         void set_wait_for_bytes_written(int value);
+        void set_idle_timeout(int msec);
+        void set_heartbeat_timeout(int msec);
+        void set_max_connections(int count);
+        void set_max_connections_per_address(int count);
 
         bool is_run()const;
 
         template<typename T>
         QByteArray IntToArray(T source)
         {
-            QByteArray temp;
-            QDataStream data(&temp, QIODevice::ReadWrite);
-            data << source;
-            return temp;
+            return Codec::encode(source);
         }
 
         template<typename T>
-        T ArrayToInt(QByteArray temp)
+        T ArrayToInt(const QByteArray &temp)
         {
-            qint32 value = 0;
-            QDataStream data(&temp, QIODevice::ReadWrite);
-            data >> value;
+            T value = 0;
+            Codec::Reader(temp).read(value);
             return value;
         }
 
     private:
         bool is_valid_socket(QTcpSocket*) const;
+        QSharedPointer<ConnectionContext> context(QTcpSocket *socket) const;
+        bool enqueue_data(QTcpSocket *socket, ConnectionContext &connection, const QByteArray &data, SlowClientPolicy policy);
+        void schedule_outbound();
+        bool service_outbound(QTcpSocket *socket, ConnectionContext &connection, qint64 now, qint64 &delay, bool &is_progress);
+        void arm_outbound_timer(qint64 delay);
+        void activate_outbound(QTcpSocket *socket, ConnectionContext &connection);
+        qint64 traffic_delay(ConnectionContext &connection, Direction direction, qint64 bytes, qint64 now);
+        void consume_traffic(ConnectionContext &connection, Direction direction, qint64 bytes, qint64 now);
+        void pause_read(QTcpSocket *socket, ConnectionContext &connection, qint64 delay);
+        void resume_reads();
+        void release_context(QTcpSocket *socket);
+        void schedule_timeout(QTcpSocket *socket, ConnectionContext &connection);
+        qint64 next_deadline(const ConnectionContext &connection) const;
+        void update_reaper();
+        void fill_stats(const ConnectionContext &connection, ConnectionStatsSnapshot &snapshot) const;
+        void reap_connections();
+
+        struct TimeoutEntry
+        {
+            QTcpSocket *socket;
+            quint64 id;
+            quint64 generation;
+        };
+
+        static constexpr qint64 DEFAULT_OUTBOUND_LIMIT = 4 * 1024 * 1024;
+        static constexpr qint64 SOCKET_BUFFER_THRESHOLD = 64 * 1024;
+        static constexpr qint64 DRR_QUANTUM = 16 * 1024;
+        static constexpr qint64 LIMITED_READ_BUFFER_SIZE = 256 * 1024;
 
         QString _addr;
         quint16 _port;
         QTcpServer _server;
         QList<QTcpSocket*>  _sockets;
         QMap<QTcpSocket*,QSharedPointer<QMutex>> _sockets_mutexes;
+        QHash<QTcpSocket*,QSharedPointer<ConnectionContext>> _contexts;
         QMutex *_mutex;
         int _wait_for_bytes_written;
+        qint64 _outbound_limit;
+
+        QHash<QString,int> _address_counts;
+        quint64 _last_connection_id;
+        int _max_connections;
+        int _max_connections_per_address;
+        int _idle_timeout;
+        int _heartbeat_timeout;
+        QElapsedTimer _clock;
+        QTimer _reaper;
+        TimingWheel<TimeoutEntry> _timeouts;
+
+        TrafficLimits _connection_limits;
+        TrafficLimits _user_limits;
+        QHash<QString,QWeakPointer<TrafficLimits>> _users_limits;
+        QList<QTcpSocket*> _active_outbound;
+        QList<QTcpSocket*> _paused_reads;
+        QTimer _outbound_timer;
+        QTimer _inbound_timer;
     };
 }
 
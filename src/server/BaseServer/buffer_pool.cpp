@@ -0,0 +1,262 @@
+#include "buffer_pool.h"
+
+#include <cstring>
+#include <utility>
+
+namespace dt = DataTransfer;
+
+namespace DataTransfer
+{
+    struct BufferPoolHolder
+    {
+        BufferPool *pool = new BufferPool();
+
+        ~BufferPoolHolder()
+        {
+            pool->orphan();
+        }
+    };
+}
+
+dt::BufferPool &dt::BufferPool::local()
+{
+    thread_local BufferPoolHolder holder;
+    return *holder.pool;
+}
+
+dt::BufferPool::BufferPool():
+    _returned(nullptr),
+    _outstanding(1),
+    _allocated(0),
+    _is_orphaned(false)
+{
+    _free.reserve(MAX_FREE_BLOCKS);
+}
+
+dt::BufferPool::~BufferPool()
+{
+    drain_returned();
+    for (auto block : _free)
+    {
+        delete block;
+    }
+}
+
+int dt::BufferPool::count_free()const
+{
+    return static_cast<int>(_free.size());
+}
+
+qint64 dt::BufferPool::count_allocated()const
+{
+    return _allocated;
+}
+
+void dt::BufferPool::drain_returned()
+{
+    Block *block = _returned.exchange(nullptr, std::memory_order_acquire);
+    while(block)
+    {
+        Block *next = block->next;
+        if(_free.size() < MAX_FREE_BLOCKS)
+        {
+            _free.push_back(block);
+        }
+        else
+        {
+            delete block;
+        }
+        block = next;
+    }
+}
+
+dt::BufferPool::Block *dt::BufferPool::acquire()
+{
+    if(_free.empty())
+    {
+        drain_returned();
+    }
+
+    Block *block = nullptr;
+    if(!_free.empty())
+    {
+        block = _free.back();
+        _free.pop_back();
+    }
+    else
+    {
+        block = new Block;
+        block->owner = this;
+        _allocated++;
+    }
+    block->refs.store(1, std::memory_order_relaxed);
+    block->next = nullptr;
+    _outstanding++;
+    return block;
+}
+
+void dt::BufferPool::release(Block *block)
+{
+    if(_is_orphaned)
+    {
+        delete block;
+        if(--_outstanding == 0)
+        {
+            delete this;
+        }
+        return;
+    }
+
+    Block *head = _returned.load(std::memory_order_relaxed);
+    do
+    {
+        block->next = head;
+    }
+    while(!_returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+
+    if(--_outstanding == 0)
+    {
+        delete this;
+    }
+}
+
+// The owning thread holds one reference of its own, so whichever side drops
+// the last reference deletes the pool exactly once.
+void dt::BufferPool::orphan()
+{
+    _is_orphaned = true;
+    drain_returned();
+    if(--_outstanding == 0)
+    {
+        delete this;
+    }
+}
+
+dt::BufferSlice dt::BufferSlice::allocate()
+{
+    return BufferSlice(BufferPool::local().acquire(), 0, BLOCK_SIZE);
+}
+
+dt::BufferSlice::BufferSlice():
+    _block(nullptr),
+    _offset(0),
+    _size(0)
+{}
+
+dt::BufferSlice::BufferSlice(Block *block, int offset, int size):
+    _block(block),
+    _offset(offset),
+    _size(size)
+{}
+
+dt::BufferSlice::BufferSlice(const BufferSlice &other):
+    _block(other._block),
+    _offset(other._offset),
+    _size(other._size)
+{
+    if(_block)
+    {
+        _block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+dt::BufferSlice::BufferSlice(BufferSlice &&other):
+    _block(other._block),
+    _offset(other._offset),
+    _size(other._size)
+{
+    other._block = nullptr;
+    other._offset = other._size = 0;
+}
+
+dt::BufferSlice &dt::BufferSlice::operator=(const BufferSlice &other)
+{
+    BufferSlice copy(other);
+    std::swap(_block, copy._block);
+    std::swap(_offset, copy._offset);
+    std::swap(_size, copy._size);
+    return *this;
+}
+
+dt::BufferSlice &dt::BufferSlice::operator=(BufferSlice &&other)
+{
+    if(this != &other)
+    {
+        clear();
+        std::swap(_block, other._block);
+        std::swap(_offset, other._offset);
+        std::swap(_size, other._size);
+    }
+    return *this;
+}
+
+dt::BufferSlice::~BufferSlice()
+{
+    clear();
+}
+
+void dt::BufferSlice::clear()
+{
+    if(_block && _block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        _block->owner->release(_block);
+    }
+    _block = nullptr;
+    _offset = _size = 0;
+}
+
+char *dt::BufferSlice::data()
+{
+    return _block ? _block->data + _offset : nullptr;
+}
+
+const char *dt::BufferSlice::data()const
+{
+    return _block ? _block->data + _offset : nullptr;
+}
+
+int dt::BufferSlice::size()const
+{
+    return _size;
+}
+
+bool dt::BufferSlice::is_empty()const
+{
+    return _size == 0;
+}
+
+dt::BufferSlice dt::BufferSlice::mid(int position, int length)const
+{
+    if(!_block || position < 0 || position > _size)
+    {
+        return BufferSlice();
+    }
+    if(length < 0 || position + length > _size)
+    {
+        length = _size - position;
+    }
+    _block->refs.fetch_add(1, std::memory_order_relaxed);
+    return BufferSlice(_block, _offset + position, length);
+}
+
+// Grows this slice over next when next starts where this one ends in the
+// same block, as consecutive reads into one block do.
+bool dt::BufferSlice::extend(const BufferSlice &next)
+{
+    if(!_block || next._block != _block || _offset + _size != next._offset)
+    {
+        return false;
+    }
+    _size += next._size;
+    return true;
+}
+
+QByteArray dt::BufferSlice::to_byte_array()const
+{
+    return QByteArray(data(), _size);
+}
+
+QByteArray dt::BufferSlice::raw_data()const
+{
+    return QByteArray::fromRawData(data(), _size);
+}
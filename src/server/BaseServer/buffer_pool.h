@@ -0,0 +1,92 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+#include <atomic>
+#include <vector>
+
+namespace DataTransfer
+{
+    class BufferPool;
+
+    class BufferSlice
+    {
+    public:
+        static constexpr int BLOCK_SIZE = 16 * 1024;
+
+        static BufferSlice allocate();
+
+        BufferSlice();
+        BufferSlice(const BufferSlice &other);
+        BufferSlice(BufferSlice &&other);
+        BufferSlice& operator=(const BufferSlice &other);
+        BufferSlice& operator=(BufferSlice &&other);
+        ~BufferSlice();
+
+        char *data();
+        const char *data()const;
+        int size()const;
+        bool is_empty()const;
+
+        BufferSlice mid(int position, int length = -1)const;
+        bool extend(const BufferSlice &next);
+        QByteArray to_byte_array()const;
+        QByteArray raw_data()const;
+
+        void clear();
+
+    private:
+        friend class BufferPool;
+
+        struct Block
+        {
+            std::atomic_int refs;
+            BufferPool *owner;
+            Block *next;
+            char data[BLOCK_SIZE];
+        };
+
+        BufferSlice(Block *block, int offset, int size);
+
+        Block *_block;
+        int _offset;
+        int _size;
+    };
+
+    // One pool per thread. Blocks released on another thread go back to their
+    // owner through a lock-free stack that the owner drains on its next acquire.
+    class BufferPool
+    {
+    public:
+        static BufferPool &local();
+
+        int count_free()const;
+        qint64 count_allocated()const;
+
+    private:
+        friend class BufferSlice;
+        friend struct BufferPoolHolder;
+
+        using Block = BufferSlice::Block;
+
+        static constexpr int MAX_FREE_BLOCKS = 1024;
+
+        BufferPool();
+        ~BufferPool();
+
+        Block *acquire();
+        void release(Block *block);
+        void orphan();
+        void drain_returned();
+
+        std::vector<Block*> _free;
+        std::atomic<Block*> _returned;
+        std::atomic<qint64> _outstanding;
+        std::atomic<qint64> _allocated;
+        std::atomic_bool _is_orphaned;
+    };
+}
+
+#endif // BUFFER_POOL_H
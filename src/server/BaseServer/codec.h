@@ -0,0 +1,324 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+
+#include <tuple>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+namespace DataTransfer
+{
+    namespace Codec
+    {
+        // Wire format matches QDataStream (big endian, QString as quint32 byte
+        // length + UTF-16BE, QByteArray as quint32 length + bytes, 0xFFFFFFFF
+        // for null), so both sides can be migrated independently.
+
+        template<typename T, typename Enable = void>
+        struct Serializer;
+
+        template<typename T>
+        struct Serializer<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T,bool>::value>::type>
+        {
+            using Unsigned = typename std::make_unsigned<T>::type;
+
+            static constexpr int size(T)
+            {
+                return sizeof(T);
+            }
+
+            static constexpr char *write(char *out, T value)
+            {
+                Unsigned raw = static_cast<Unsigned>(value);
+                for (int i = static_cast<int>(sizeof(T)) - 1; i >= 0; i--)
+                {
+                    out[i] = static_cast<char>(raw & 0xFF);
+                    raw = static_cast<Unsigned>(raw >> 8);
+                }
+                return out + sizeof(T);
+            }
+
+            static constexpr const char *read(const char *in, const char *end, T &value)
+            {
+                if(end - in < static_cast<std::ptrdiff_t>(sizeof(T)))
+                {
+                    return nullptr;
+                }
+                Unsigned raw = 0;
+                for (unsigned int i = 0; i < sizeof(T); i++)
+                {
+                    raw = static_cast<Unsigned>((raw << 8) | static_cast<unsigned char>(in[i]));
+                }
+                value = static_cast<T>(raw);
+                return in + sizeof(T);
+            }
+        };
+
+        template<>
+        struct Serializer<bool>
+        {
+            static constexpr int size(bool)
+            {
+                return 1;
+            }
+
+            static constexpr char *write(char *out, bool value)
+            {
+                *out = value ? 1 : 0;
+                return out + 1;
+            }
+
+            static constexpr const char *read(const char *in, const char *end, bool &value)
+            {
+                if(in == end)
+                {
+                    return nullptr;
+                }
+                value = *in != 0;
+                return in + 1;
+            }
+        };
+
+        template<>
+        struct Serializer<QString>
+        {
+            static constexpr quint32 NULL_STRING = 0xFFFFFFFF;
+
+            static int size(const QString &value)
+            {
+                return static_cast<int>(sizeof(quint32)) + (value.isNull() ? 0 : value.size() * 2);
+            }
+
+            static char *write(char *out, const QString &value)
+            {
+                if(value.isNull())
+                {
+                    return Serializer<quint32>::write(out, NULL_STRING);
+                }
+                out = Serializer<quint32>::write(out, static_cast<quint32>(value.size() * 2));
+                const ushort *units = value.utf16();
+                for (int i = 0; i < value.size(); i++)
+                {
+                    out = Serializer<quint16>::write(out, units[i]);
+                }
+                return out;
+            }
+
+            static const char *read(const char *in, const char *end, QString &value)
+            {
+                quint32 length = 0;
+                in = Serializer<quint32>::read(in, end, length);
+                if(!in)
+                {
+                    return nullptr;
+                }
+                if(length == NULL_STRING)
+                {
+                    value = QString();
+                    return in;
+                }
+                if((length & 1) || static_cast<quint32>(end - in) < length)
+                {
+                    return nullptr;
+                }
+                int count = static_cast<int>(length / 2);
+                value.resize(count);
+                QChar *units = value.data();
+                for (int i = 0; i < count; i++)
+                {
+                    quint16 unit = 0;
+                    in = Serializer<quint16>::read(in, end, unit);
+                    units[i] = QChar(unit);
+                }
+                return in;
+            }
+        };
+
+        template<>
+        struct Serializer<QByteArray>
+        {
+            static constexpr quint32 NULL_ARRAY = 0xFFFFFFFF;
+
+            static int size(const QByteArray &value)
+            {
+                return static_cast<int>(sizeof(quint32)) + value.size();
+            }
+
+            static char *write(char *out, const QByteArray &value)
+            {
+                if(value.isNull())
+                {
+                    return Serializer<quint32>::write(out, NULL_ARRAY);
+                }
+                out = Serializer<quint32>::write(out, static_cast<quint32>(value.size()));
+                memcpy(out, value.constData(), static_cast<size_t>(value.size()));
+                return out + value.size();
+            }
+
+            static const char *read(const char *in, const char *end, QByteArray &value)
+            {
+                quint32 length = 0;
+                in = Serializer<quint32>::read(in, end, length);
+                if(!in)
+                {
+                    return nullptr;
+                }
+                if(length == NULL_ARRAY)
+                {
+                    value = QByteArray();
+                    return in;
+                }
+                if(static_cast<quint32>(end - in) < length)
+                {
+                    return nullptr;
+                }
+                value = QByteArray(in, static_cast<int>(length));
+                return in + length;
+            }
+        };
+
+        template<typename... Args>
+        struct Serializer<std::tuple<Args...>>
+        {
+            using Tuple = std::tuple<Args...>;
+            using Indexes = std::index_sequence_for<Args...>;
+
+            static int size(const Tuple &value)
+            {
+                return size(value, Indexes());
+            }
+
+            static char *write(char *out, const Tuple &value)
+            {
+                return write(out, value, Indexes());
+            }
+
+            static const char *read(const char *in, const char *end, Tuple &value)
+            {
+                return read(in, end, value, Indexes());
+            }
+
+        private:
+            template<std::size_t... I>
+            static int size(const Tuple &value, std::index_sequence<I...>)
+            {
+                int total = 0;
+                int sizes[] = {0, (total += Serializer<typename std::tuple_element<I,Tuple>::type>::size(std::get<I>(value)))...};
+                Q_UNUSED(sizes);
+                return total;
+            }
+
+            template<std::size_t... I>
+            static char *write(char *out, const Tuple &value, std::index_sequence<I...>)
+            {
+                char *outs[] = {out, (out = Serializer<typename std::tuple_element<I,Tuple>::type>::write(out, std::get<I>(value)))...};
+                Q_UNUSED(outs);
+                return out;
+            }
+
+            template<std::size_t... I>
+            static const char *read(const char *in, const char *end, Tuple &value, std::index_sequence<I...>)
+            {
+                const char *ins[] = {in, (in = in ? Serializer<typename std::tuple_element<I,Tuple>::type>::read(in, end, std::get<I>(value)) : nullptr)...};
+                Q_UNUSED(ins);
+                return in;
+            }
+        };
+
+        inline int encoded_size()
+        {
+            return 0;
+        }
+
+        template<typename T, typename... Args>
+        int encoded_size(const T &value, const Args&... args)
+        {
+            return Serializer<T>::size(value) + encoded_size(args...);
+        }
+
+        inline char *write_all(char *out)
+        {
+            return out;
+        }
+
+        template<typename T, typename... Args>
+        char *write_all(char *out, const T &value, const Args&... args)
+        {
+            return write_all(Serializer<T>::write(out, value), args...);
+        }
+
+        template<typename... Args>
+        QByteArray &append(QByteArray &buffer, const Args&... args)
+        {
+            int offset = buffer.size();
+            buffer.resize(offset + encoded_size(args...));
+            write_all(buffer.data() + offset, args...);
+            return buffer;
+        }
+
+        template<typename... Args>
+        QByteArray encode(const Args&... args)
+        {
+            QByteArray buffer;
+            return append(buffer, args...);
+        }
+
+        class Reader
+        {
+        public:
+            Reader(const char *data, int size):
+                _begin(data),
+                _current(data),
+                _end(data + size)
+            {}
+
+            explicit Reader(const QByteArray &data):
+                Reader(data.constData(), data.size())
+            {}
+
+            template<typename T>
+            bool read(T &value)
+            {
+                if(!_current)
+                {
+                    return false;
+                }
+                _current = Serializer<T>::read(_current, _end, value);
+                return _current != nullptr;
+            }
+
+            template<typename T>
+            Reader &operator>>(T &value)
+            {
+                read(value);
+                return *this;
+            }
+
+            bool is_valid()const
+            {
+                return _current != nullptr;
+            }
+
+            bool at_end()const
+            {
+                return _current == _end;
+            }
+
+            int position()const
+            {
+                return _current ? static_cast<int>(_current - _begin) : -1;
+            }
+
+        private:
+            const char *_begin;
+            const char *_current;
+            const char *_end;
+        };
+    }
+}
+
+#endif // CODEC_H
@@ -0,0 +1,219 @@
+#include "compression.h"
+#include "codec.h"
+
+#include <cstring>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace dt = DataTransfer;
+
+quint8 dt::Compression::supported_methods()
+{
+    quint8 methods = ZLIB;
+#ifdef HAVE_LZ4
+    methods |= LZ4;
+#endif
+#ifdef HAVE_ZSTD
+    methods |= ZSTD;
+#endif
+    return methods;
+}
+
+dt::Compression::Compression():
+    _zstd_compress_context(nullptr),
+    _zstd_decompress_context(nullptr)
+{
+#ifdef HAVE_LZ4
+    _lz4_state.resize(LZ4_sizeofState());
+#endif
+#ifdef HAVE_ZSTD
+    _zstd_compress_context = ZSTD_createCCtx();
+    _zstd_decompress_context = ZSTD_createDCtx();
+#endif
+}
+
+dt::Compression::~Compression()
+{
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(_zstd_compress_context));
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(_zstd_decompress_context));
+#endif
+}
+
+bool dt::Compression::negotiate(quint8 remote_methods)
+{
+    quint8 common = supported_methods() & remote_methods;
+
+    _control = TrafficState();
+    _bulk = TrafficState();
+
+    if(common & LZ4)
+    {
+        _control.method = LZ4;
+    }
+    else if(common & ZSTD)
+    {
+        _control.method = ZSTD;
+    }
+    else if(common & ZLIB)
+    {
+        _control.method = ZLIB;
+    }
+
+    if(common & ZSTD)
+    {
+        _bulk.method = ZSTD;
+    }
+    else if(common & ZLIB)
+    {
+        _bulk.method = ZLIB;
+    }
+    else if(common & LZ4)
+    {
+        _bulk.method = LZ4;
+    }
+
+    return common != NONE;
+}
+
+dt::Compression::Method dt::Compression::method(Traffic traffic)const
+{
+    return traffic == Traffic::BULK ? _bulk.method : _control.method;
+}
+
+dt::Compression::TrafficState &dt::Compression::state(Traffic traffic)
+{
+    return traffic == Traffic::BULK ? _bulk : _control;
+}
+
+// Returns false when the payload goes out as is: compression is off for this
+// traffic, the payload is too small or too large, or it did not shrink.
+bool dt::Compression::pack(const QByteArray &data, QByteArray &out, Traffic traffic)
+{
+    auto &current = state(traffic);
+    if(current.method == NONE || data.size() < MIN_COMPRESS_SIZE || static_cast<quint32>(data.size()) > MAX_RAW_SIZE)
+    {
+        return false;
+    }
+    if(current.bypass > 0)
+    {
+        current.bypass--;
+        return false;
+    }
+
+    if(!compress(current.method, traffic, data, out, HEADER_SIZE)
+            || out.size() - HEADER_SIZE >= data.size() - data.size() / 8)
+    {
+        if(++current.incompressible >= INCOMPRESSIBLE_LIMIT)
+        {
+            current.incompressible = 0;
+            current.bypass = BYPASS_MESSAGES;
+        }
+        out.clear();
+        return false;
+    }
+
+    current.incompressible = 0;
+    Codec::write_all(out.data(), static_cast<quint8>(current.method), static_cast<quint32>(data.size()));
+    return true;
+}
+
+bool dt::Compression::unpack(const QByteArray &payload, QByteArray &data)
+{
+    if(payload.size() < HEADER_SIZE)
+    {
+        return false;
+    }
+
+    quint8 used = NONE;
+    quint32 raw_size = 0;
+    Codec::Reader header(payload.constData(), HEADER_SIZE);
+    header >> used >> raw_size;
+    if(used == NONE || !(used & supported_methods()) || raw_size > MAX_RAW_SIZE)
+    {
+        return false;
+    }
+    return decompress(static_cast<Method>(used), payload.constData() + HEADER_SIZE, payload.size() - HEADER_SIZE,
+                      static_cast<int>(raw_size), data);
+}
+
+bool dt::Compression::compress(Method method, Traffic traffic, const QByteArray &data, QByteArray &out, int offset)
+{
+    switch (method)
+    {
+    case ZLIB:
+    {
+        QByteArray compressed = qCompress(data, traffic == Traffic::BULK ? ZLIB_BULK_LEVEL : ZLIB_CONTROL_LEVEL);
+        out.reserve(offset + compressed.size());
+        out.resize(offset);
+        out.append(compressed);
+        return !compressed.isEmpty();
+    }
+#ifdef HAVE_LZ4
+    case LZ4:
+    {
+        int bound = LZ4_compressBound(data.size());
+        out.resize(offset + bound);
+        int size = LZ4_compress_fast_extState(_lz4_state.data(), data.constData(), out.data() + offset, data.size(), bound, 1);
+        out.resize(offset + (size > 0 ? size : 0));
+        return size > 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case ZSTD:
+    {
+        size_t bound = ZSTD_compressBound(static_cast<size_t>(data.size()));
+        out.resize(offset + static_cast<int>(bound));
+        size_t size = ZSTD_compressCCtx(static_cast<ZSTD_CCtx*>(_zstd_compress_context),
+                                        out.data() + offset, bound,
+                                        data.constData(), static_cast<size_t>(data.size()),
+                                        traffic == Traffic::BULK ? ZSTD_BULK_LEVEL : ZSTD_CONTROL_LEVEL);
+        if(ZSTD_isError(size))
+        {
+            return false;
+        }
+        out.resize(offset + static_cast<int>(size));
+        return true;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+bool dt::Compression::decompress(Method method, const char *data, int size, int raw_size, QByteArray &out)
+{
+    switch (method)
+    {
+    case ZLIB:
+    {
+        out = qUncompress(reinterpret_cast<const uchar*>(data), size);
+        return out.size() == raw_size;
+    }
+#ifdef HAVE_LZ4
+    case LZ4:
+    {
+        out.resize(raw_size);
+        return LZ4_decompress_safe(data, out.data(), size, raw_size) == raw_size;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case ZSTD:
+    {
+        out.resize(raw_size);
+        size_t result = ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(_zstd_decompress_context),
+                                            out.data(), static_cast<size_t>(raw_size),
+                                            data, static_cast<size_t>(size));
+        return !ZSTD_isError(result) && result == static_cast<size_t>(raw_size);
+    }
+#endif
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+#include "protocol.h"
+
+namespace DataTransfer
+{
+    class Compression
+    {
+    public:
+        enum Method : quint8
+        {
+            NONE = 0x00,
+            ZLIB = 0x01,
+            LZ4 = 0x02,
+            ZSTD = 0x04
+        };
+
+        enum class Traffic {CONTROL = 0, BULK};
+
+        // Prefix of a Protocol::COMPRESSED payload: method, raw size.
+        static constexpr int HEADER_SIZE = 5;
+
+        static quint8 supported_methods();
+
+        Compression();
+        Compression(const Compression&) = delete;
+        Compression& operator=(const Compression&) = delete;
+        virtual ~Compression();
+
+        bool negotiate(quint8 remote_methods);
+        Method method(Traffic traffic)const;
+
+        bool pack(const QByteArray &data, QByteArray &out, Traffic traffic = Traffic::CONTROL);
+        bool unpack(const QByteArray &payload, QByteArray &data);
+
+    private:
+        static constexpr int MIN_COMPRESS_SIZE = 128;
+        static constexpr quint32 MAX_RAW_SIZE = Protocol::MAX_PAYLOAD_SIZE;
+        static constexpr int INCOMPRESSIBLE_LIMIT = 8;
+        static constexpr int BYPASS_MESSAGES = 32;
+        static constexpr int ZLIB_CONTROL_LEVEL = 1;
+        static constexpr int ZLIB_BULK_LEVEL = 6;
+        static constexpr int ZSTD_CONTROL_LEVEL = 1;
+        static constexpr int ZSTD_BULK_LEVEL = 9;
+
+        struct TrafficState
+        {
+            Method method = NONE;
+            int incompressible = 0;
+            int bypass = 0;
+        };
+
+        TrafficState &state(Traffic traffic);
+        bool compress(Method method, Traffic traffic, const QByteArray &data, QByteArray &out, int offset);
+        bool decompress(Method method, const char *data, int size, int raw_size, QByteArray &out);
+
+        TrafficState _control;
+        TrafficState _bulk;
+
+        QByteArray _lz4_state;
+        void *_zstd_compress_context;
+        void *_zstd_decompress_context;
+    };
+}
+
+#endif // COMPRESSION_H
@@ -0,0 +1,42 @@
+#ifndef CONNECTION_CONTEXT_H
+#define CONNECTION_CONTEXT_H
+
+#include <QByteArray>
+#include <QQueue>
+#include <QString>
+#include <QSharedPointer>
+
+#include "token_bucket.h"
+#include "buffer_pool.h"
+#include "connection_stats.h"
+
+namespace DataTransfer
+{
+    struct ConnectionContext
+    {
+        quint64 id = 0;
+        QString address;
+        quint16 port = 0;
+        qint64 last_inbound = 0;
+        qint64 last_activity = 0;
+        bool is_scheduled = false;
+        qint64 scheduled_deadline = 0;
+        quint64 timeout_generation = 0;
+
+        BufferSlice read_block;
+        int read_offset = 0;
+        QQueue<QByteArray> outbound;
+        qint64 outbound_bytes = 0;
+
+        QString user;
+        TrafficLimits limits;
+        QSharedPointer<TrafficLimits> user_limits;
+        qint64 deficit = 0;
+        bool is_active = false;
+        bool is_read_paused = false;
+
+        ConnectionStats stats;
+    };
+}
+
+#endif // CONNECTION_CONTEXT_H
@@ -0,0 +1,101 @@
+#include "connection_stats.h"
+
+#include <QtAlgorithms>
+
+namespace dt = DataTransfer;
+
+qint64 dt::ConnectionStatsSnapshot::count_requests()const
+{
+    qint64 count = 0;
+    for (auto value : latency_histogram)
+    {
+        count += value;
+    }
+    return count;
+}
+
+// Returns the upper bound of the bucket holding the percentile, so the result
+// overestimates the real latency by at most a factor of two.
+qint64 dt::ConnectionStatsSnapshot::latency_percentile(double fraction)const
+{
+    qint64 count = count_requests();
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    qint64 rank = qMax<qint64>(1, static_cast<qint64>(fraction * count + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < latency_histogram.size(); i++)
+    {
+        seen += latency_histogram[i];
+        if(seen >= rank)
+        {
+            return qint64(1) << i;
+        }
+    }
+    return qint64(1) << (latency_histogram.size() - 1);
+}
+
+dt::ConnectionStats::ConnectionStats():
+    _bytes_in(0),
+    _bytes_out(0),
+    _messages_in(0),
+    _messages_out(0),
+    _queued_bytes(0),
+    _last_activity(0)
+{
+    for (auto &bucket : _latency)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void dt::ConnectionStats::touch(qint64 now_msec)
+{
+    _last_activity.store(now_msec, std::memory_order_relaxed);
+}
+
+void dt::ConnectionStats::add_inbound(qint64 bytes, qint64 now_msec)
+{
+    _bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+    touch(now_msec);
+}
+
+void dt::ConnectionStats::add_inbound_message()
+{
+    _messages_in.fetch_add(1, std::memory_order_relaxed);
+}
+
+void dt::ConnectionStats::add_outbound(qint64 bytes, qint64 now_msec)
+{
+    _bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+    _messages_out.fetch_add(1, std::memory_order_relaxed);
+    touch(now_msec);
+}
+
+void dt::ConnectionStats::set_queued(qint64 bytes)
+{
+    _queued_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void dt::ConnectionStats::add_latency(qint64 usec)
+{
+    int index = usec > 0 ? 64 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(usec))) : 0;
+    _latency[qMin(index, LATENCY_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void dt::ConnectionStats::fill(ConnectionStatsSnapshot &snapshot, qint64 now_msec)const
+{
+    snapshot.bytes_in = _bytes_in.load(std::memory_order_relaxed);
+    snapshot.bytes_out = _bytes_out.load(std::memory_order_relaxed);
+    snapshot.messages_in = _messages_in.load(std::memory_order_relaxed);
+    snapshot.messages_out = _messages_out.load(std::memory_order_relaxed);
+    snapshot.queued_bytes = _queued_bytes.load(std::memory_order_relaxed);
+    snapshot.idle_msec = qMax<qint64>(0, now_msec - _last_activity.load(std::memory_order_relaxed));
+    snapshot.latency_histogram.resize(LATENCY_BUCKETS);
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        snapshot.latency_histogram[i] = _latency[i].load(std::memory_order_relaxed);
+    }
+}
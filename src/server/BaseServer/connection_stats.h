@@ -0,0 +1,63 @@
+#ifndef CONNECTION_STATS_H
+#define CONNECTION_STATS_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+namespace DataTransfer
+{
+    struct ConnectionStatsSnapshot
+    {
+        quint64 id = 0;
+        QString address;
+        quint16 port = 0;
+        QString user;
+        qint64 bytes_in = 0;
+        qint64 bytes_out = 0;
+        // Frames parsed from the stream, not read calls.
+        qint64 messages_in = 0;
+        qint64 messages_out = 0;
+        qint64 queued_bytes = 0;
+        qint64 idle_msec = 0;
+        // Bucket i counts requests that took [2^(i-1), 2^i) microseconds.
+        QVector<qint64> latency_histogram;
+
+        qint64 count_requests()const;
+        qint64 latency_percentile(double fraction)const;
+    };
+
+    // Written by the network thread with relaxed atomics, so a snapshot taken
+    // from another thread is cheap but not a consistent cut across counters.
+    class ConnectionStats
+    {
+    public:
+        static constexpr int LATENCY_BUCKETS = 32;
+
+        ConnectionStats();
+        ConnectionStats(const ConnectionStats&) = delete;
+        ConnectionStats& operator=(const ConnectionStats&) = delete;
+
+        void touch(qint64 now_msec);
+        void add_inbound(qint64 bytes, qint64 now_msec);
+        void add_inbound_message();
+        void add_outbound(qint64 bytes, qint64 now_msec);
+        void set_queued(qint64 bytes);
+        void add_latency(qint64 usec);
+
+        void fill(ConnectionStatsSnapshot &snapshot, qint64 now_msec)const;
+
+    private:
+        std::atomic<qint64> _bytes_in;
+        std::atomic<qint64> _bytes_out;
+        std::atomic<qint64> _messages_in;
+        std::atomic<qint64> _messages_out;
+        std::atomic<qint64> _queued_bytes;
+        std::atomic<qint64> _last_activity;
+        std::atomic<qint64> _latency[LATENCY_BUCKETS];
+    };
+}
+
+#endif // CONNECTION_STATS_H
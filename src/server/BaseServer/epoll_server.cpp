@@ -0,0 +1,627 @@
+#include "epoll_server.h"
+
+#include <QHostAddress>
+#include <QMetaType>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+namespace dt = DataTransfer;
+
+namespace
+{
+    int descriptor_of(dt::EpollServer::Handle handle)
+    {
+        return static_cast<int>(handle & 0xFFFFFFFFu);
+    }
+}
+
+dt::EpollServer::EpollServer(const QString &addr,quint16 port) :
+    _addr(addr),
+    _port(port),
+    _listen_descriptor(-1),
+    _epoll_descriptor(-1),
+    _wakeup_descriptor(-1),
+    _spare_descriptor(-1),
+    _max_connections(0),
+    _last_generation(0),
+    _outbound_limit(DEFAULT_OUTBOUND_LIMIT),
+    _is_run(false),
+    _count_connections(0),
+    _read_buffer(new char[READ_BUFFER_SIZE])
+{
+    qRegisterMetaType<Handle>("Handle");
+}
+
+bool dt::EpollServer::run()
+{
+    if(_is_run)
+    {
+        return false;
+    }
+
+    QHostAddress host(_addr);
+    sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    socklen_t length = 0;
+    if(host.protocol() == QAbstractSocket::IPv6Protocol)
+    {
+        auto address = reinterpret_cast<sockaddr_in6*>(&storage);
+        address->sin6_family = AF_INET6;
+        address->sin6_port = htons(_port);
+        Q_IPV6ADDR ip = host.toIPv6Address();
+        memcpy(&address->sin6_addr, &ip, sizeof(address->sin6_addr));
+        length = sizeof(sockaddr_in6);
+    }
+    else
+    {
+        auto address = reinterpret_cast<sockaddr_in*>(&storage);
+        address->sin_family = AF_INET;
+        address->sin_port = htons(_port);
+        address->sin_addr.s_addr = htonl(host.toIPv4Address());
+        length = sizeof(sockaddr_in);
+    }
+
+    _listen_descriptor = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    _epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+    _wakeup_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _spare_descriptor = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    int reuse = 1;
+    epoll_event listen_event;
+    memset(&listen_event, 0, sizeof(listen_event));
+    // Level-triggered: connections left in the backlog after a failed
+    // accept are offered again on the next wait.
+    listen_event.events = EPOLLIN;
+    listen_event.data.u64 = static_cast<quint64>(_listen_descriptor);
+    epoll_event wakeup_event;
+    memset(&wakeup_event, 0, sizeof(wakeup_event));
+    wakeup_event.events = EPOLLIN;
+    wakeup_event.data.u64 = static_cast<quint64>(_wakeup_descriptor);
+
+    if(_listen_descriptor < 0 || _epoll_descriptor < 0 || _wakeup_descriptor < 0
+            || setsockopt(_listen_descriptor, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(_listen_descriptor, reinterpret_cast<sockaddr*>(&storage), length) != 0
+            || listen(_listen_descriptor, SOMAXCONN) != 0
+            || epoll_ctl(_epoll_descriptor, EPOLL_CTL_ADD, _listen_descriptor, &listen_event) != 0
+            || epoll_ctl(_epoll_descriptor, EPOLL_CTL_ADD, _wakeup_descriptor, &wakeup_event) != 0)
+    {
+        for (int *descriptor : {&_listen_descriptor, &_epoll_descriptor, &_wakeup_descriptor, &_spare_descriptor})
+        {
+            if(*descriptor >= 0)
+            {
+                ::close(*descriptor);
+                *descriptor = -1;
+            }
+        }
+        return false;
+    }
+
+    _is_run = true;
+    _thread = std::thread(&EpollServer::loop, this);
+    return true;
+}
+
+void dt::EpollServer::stop()
+{
+    if(!_is_run)
+    {
+        return;
+    }
+    _is_run = false;
+    quint64 value = 1;
+    ssize_t written = ::write(_wakeup_descriptor, &value, sizeof(value));
+    Q_UNUSED(written);
+    if(_thread.joinable())
+    {
+        _thread.join();
+    }
+
+    close_posted();
+    for (auto handle : get_client_sockets())
+    {
+        close_connection(handle);
+    }
+
+    for (int *descriptor : {&_listen_descriptor, &_epoll_descriptor, &_wakeup_descriptor, &_spare_descriptor})
+    {
+        if(*descriptor >= 0)
+        {
+            ::close(*descriptor);
+            *descriptor = -1;
+        }
+    }
+}
+
+void dt::EpollServer::loop()
+{
+    std::vector<epoll_event> events(MAX_EVENTS);
+    while(_is_run)
+    {
+        int count = epoll_wait(_epoll_descriptor, events.data(), MAX_EVENTS, -1);
+        if(count < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        // Descriptors are only closed on this thread, and events carry the
+        // handle, so an event left in this batch for a connection closed
+        // earlier in it finds nothing, even if accept() reused the descriptor.
+        for (int i = 0; i < count; i++)
+        {
+            quint64 key = events[i].data.u64;
+            quint32 flags = events[i].events;
+
+            if(key == static_cast<quint64>(_wakeup_descriptor))
+            {
+                quint64 value = 0;
+                while(::read(_wakeup_descriptor, &value, sizeof(value)) > 0);
+                close_posted();
+                continue;
+            }
+            if(key == static_cast<quint64>(_listen_descriptor))
+            {
+                accept_connections();
+                continue;
+            }
+
+            auto connection = find_connection(key);
+            if(!connection)
+            {
+                continue;
+            }
+            int descriptor = connection->descriptor;
+            if(flags & EPOLLERR)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &length);
+                emit socket_error(key, error);
+                close_connection(key);
+                continue;
+            }
+            if(flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            {
+                read_connection(key, descriptor);
+            }
+            if(flags & EPOLLOUT)
+            {
+                std::unique_lock<std::mutex> lock(connection->mutex);
+                if(connection->descriptor >= 0 && !flush_connection(*connection))
+                {
+                    lock.unlock();
+                    close_connection(key);
+                }
+            }
+        }
+    }
+}
+
+void dt::EpollServer::accept_connections()
+{
+    while(true)
+    {
+        sockaddr_storage storage;
+        socklen_t length = sizeof(storage);
+        int descriptor = accept4(_listen_descriptor, reinterpret_cast<sockaddr*>(&storage), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(descriptor < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // Out of descriptors: the spare one makes room to accept the peer
+            // and close it, instead of leaving it in the backlog to wake the
+            // level-triggered listener again and again.
+            if((errno == EMFILE || errno == ENFILE) && _spare_descriptor >= 0)
+            {
+                ::close(_spare_descriptor);
+                int refused = ::accept(_listen_descriptor, nullptr, nullptr);
+                if(refused >= 0)
+                {
+                    ::close(refused);
+                }
+                _spare_descriptor = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if(refused >= 0)
+                {
+                    continue;
+                }
+            }
+            return;
+        }
+        if(_max_connections > 0 && _count_connections >= _max_connections)
+        {
+            ::close(descriptor);
+            continue;
+        }
+
+        int no_delay = 1;
+        setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        if(++_last_generation == 0)
+        {
+            _last_generation = 1;
+        }
+        auto connection = std::make_shared<Connection>();
+        QHostAddress address(reinterpret_cast<sockaddr*>(&storage));
+        connection->descriptor = descriptor;
+        connection->handle = (static_cast<Handle>(_last_generation) << 32) | static_cast<quint32>(descriptor);
+        connection->address = address.toString();
+        connection->port = storage.ss_family == AF_INET6
+                ? ntohs(reinterpret_cast<sockaddr_in6*>(&storage)->sin6_port)
+                : ntohs(reinterpret_cast<sockaddr_in*>(&storage)->sin_port);
+        {
+            std::lock_guard<std::mutex> lock(_connections_mutex);
+            if(_connections.size() <= static_cast<size_t>(descriptor))
+            {
+                _connections.resize(static_cast<size_t>(descriptor) + 1);
+            }
+            _connections[static_cast<size_t>(descriptor)] = connection;
+        }
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = connection->handle;
+        if(epoll_ctl(_epoll_descriptor, EPOLL_CTL_ADD, descriptor, &event) != 0)
+        {
+            std::lock_guard<std::mutex> lock(_connections_mutex);
+            _connections[static_cast<size_t>(descriptor)].reset();
+            ::close(descriptor);
+            continue;
+        }
+
+        _count_connections++;
+        emit new_connection(connection->handle);
+    }
+}
+
+void dt::EpollServer::read_connection(Handle handle, int descriptor)
+{
+    while(true)
+    {
+        ssize_t size = ::read(descriptor, _read_buffer.get(), READ_BUFFER_SIZE);
+        if(size > 0)
+        {
+            if(_read_handler)
+            {
+                _read_handler(handle, _read_buffer.get(), size);
+            }
+            continue;
+        }
+        if(size == 0)
+        {
+            close_connection(handle);
+            return;
+        }
+        if(errno == EINTR)
+        {
+            continue;
+        }
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            emit socket_error(handle, errno);
+            close_connection(handle);
+        }
+        return;
+    }
+}
+
+bool dt::EpollServer::flush_connection(Connection &connection)
+{
+    while(!connection.outbound.empty())
+    {
+        auto &block = connection.outbound.front();
+        ssize_t size = ::send(connection.descriptor, block.data.get() + block.begin,
+                              static_cast<size_t>(block.end - block.begin), MSG_NOSIGNAL);
+        if(size > 0)
+        {
+            block.begin += static_cast<int>(size);
+            connection.outbound_bytes -= size;
+            if(block.begin == block.end)
+            {
+                release_block(block);
+                connection.outbound.pop_front();
+            }
+            continue;
+        }
+        if(size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    return true;
+}
+
+// Callers off the loop thread only mark the connection and leave the close
+// to the loop, which is the only place a descriptor is closed while running.
+void dt::EpollServer::post_close(Handle handle)
+{
+    if(!_is_run)
+    {
+        close_connection(handle);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_closes_mutex);
+        _closes.push_back(handle);
+    }
+    quint64 value = 1;
+    ssize_t written = ::write(_wakeup_descriptor, &value, sizeof(value));
+    Q_UNUSED(written);
+}
+
+void dt::EpollServer::close_posted()
+{
+    std::vector<Handle> closes;
+    {
+        std::lock_guard<std::mutex> lock(_closes_mutex);
+        closes.swap(_closes);
+    }
+    for (auto handle : closes)
+    {
+        close_connection(handle);
+    }
+}
+
+void dt::EpollServer::close_connection(Handle handle)
+{
+    int descriptor = descriptor_of(handle);
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(_connections_mutex);
+        if(descriptor >= 0 && static_cast<size_t>(descriptor) < _connections.size()
+                && _connections[static_cast<size_t>(descriptor)]
+                && _connections[static_cast<size_t>(descriptor)]->handle == handle)
+        {
+            connection.swap(_connections[static_cast<size_t>(descriptor)]);
+        }
+    }
+    if(!connection)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        epoll_ctl(_epoll_descriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+        for (auto &block : connection->outbound)
+        {
+            release_block(block);
+        }
+        connection->outbound.clear();
+        connection->outbound_bytes = 0;
+        ::close(descriptor);
+        connection->descriptor = -1;
+    }
+
+    _count_connections--;
+    emit disconnected_socket(handle);
+}
+
+std::shared_ptr<dt::EpollServer::Connection> dt::EpollServer::find_connection(Handle handle) const
+{
+    int descriptor = descriptor_of(handle);
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    if(descriptor < 0 || static_cast<size_t>(descriptor) >= _connections.size())
+    {
+        return nullptr;
+    }
+    auto &connection = _connections[static_cast<size_t>(descriptor)];
+    if(!connection || connection->handle != handle)
+    {
+        return nullptr;
+    }
+    return connection;
+}
+
+void dt::EpollServer::remove_connection(Handle handle)
+{
+    auto connection = find_connection(handle);
+    if(!connection)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->is_closing = true;
+    }
+    post_close(handle);
+}
+
+QVector<QPair<QString,quint16>> dt::EpollServer::info_connection()
+{
+    QVector<QPair<QString,quint16>> data;
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    data.reserve(_count_connections);
+    for (auto &connection : _connections)
+    {
+        if(connection)
+        {
+            data.push_back(qMakePair(connection->address, connection->port));
+        }
+    }
+    return data;
+}
+
+QList<dt::EpollServer::Handle> dt::EpollServer::get_client_sockets() const
+{
+    QList<Handle> handles;
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    for (auto &connection : _connections)
+    {
+        if(connection)
+        {
+            handles.push_back(connection->handle);
+        }
+    }
+    return handles;
+}
+
+int dt::EpollServer::count_connections() const
+{
+    return _count_connections;
+}
+
+// Same rules as BaseServer: once a peer has more than the outbound limit
+// queued, SKIP refuses the message, DROP also closes the connection and
+// QUEUE appends regardless. A message is never cut, so the check is made
+// before anything of it is sent.
+bool dt::EpollServer::write_data(Handle handle, const QByteArray &data, SlowClientPolicy policy)
+{
+    auto connection = find_connection(handle);
+    if(!connection || data.isEmpty())
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(connection->mutex);
+    if(connection->descriptor < 0 || connection->is_closing)
+    {
+        return false;
+    }
+    if(policy != SlowClientPolicy::QUEUE && !connection->outbound.empty()
+            && connection->outbound_bytes + data.size() > _outbound_limit)
+    {
+        if(policy == SlowClientPolicy::DROP)
+        {
+            connection->is_closing = true;
+            lock.unlock();
+            post_close(handle);
+        }
+        return false;
+    }
+
+    const char *current = data.constData();
+    int remaining = data.size();
+    if(connection->outbound.empty())
+    {
+        while(remaining > 0)
+        {
+            ssize_t size = ::send(connection->descriptor, current, static_cast<size_t>(remaining), MSG_NOSIGNAL);
+            if(size > 0)
+            {
+                current += size;
+                remaining -= static_cast<int>(size);
+                continue;
+            }
+            if(size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            return false;
+        }
+    }
+
+    while(remaining > 0)
+    {
+        if(connection->outbound.empty() || connection->outbound.back().end == BLOCK_SIZE)
+        {
+            connection->outbound.push_back(acquire_block());
+        }
+        auto &block = connection->outbound.back();
+        int size = qMin(remaining, BLOCK_SIZE - block.end);
+        memcpy(block.data.get() + block.end, current, static_cast<size_t>(size));
+        block.end += size;
+        connection->outbound_bytes += size;
+        current += size;
+        remaining -= size;
+    }
+    return true;
+}
+
+int dt::EpollServer::broadcast_data(const QByteArray &data, SlowClientPolicy policy)
+{
+    std::vector<std::shared_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(_connections_mutex);
+        connections.reserve(static_cast<size_t>(_count_connections.load()));
+        for (auto &connection : _connections)
+        {
+            if(connection)
+            {
+                connections.push_back(connection);
+            }
+        }
+    }
+
+    int count = 0;
+    for (auto &connection : connections)
+    {
+        if(write_data(connection->handle, data, policy))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+dt::EpollServer::Block dt::EpollServer::acquire_block()
+{
+    Block block;
+    {
+        std::lock_guard<std::mutex> lock(_blocks_mutex);
+        if(!_free_blocks.empty())
+        {
+            block.data = std::move(_free_blocks.back());
+            _free_blocks.pop_back();
+        }
+    }
+    if(!block.data)
+    {
+        block.data.reset(new char[BLOCK_SIZE]);
+    }
+    return block;
+}
+
+void dt::EpollServer::release_block(Block &block)
+{
+    std::lock_guard<std::mutex> lock(_blocks_mutex);
+    if(block.data && _free_blocks.size() < MAX_FREE_BLOCKS)
+    {
+        _free_blocks.push_back(std::move(block.data));
+    }
+    block.begin = block.end = 0;
+}
+
+void dt::EpollServer::set_read_handler(ReadHandler handler)
+{
+    _read_handler = handler;
+}
+
+void dt::EpollServer::set_max_connections(int count)
+{
+    _max_connections = count;
+}
+
+void dt::EpollServer::set_outbound_limit(qint64 bytes)
+{
+    _outbound_limit = bytes;
+}
+
+bool dt::EpollServer::is_run()const
+{
+    return _is_run;
+}
+
+dt::EpollServer::~EpollServer()
+{
+    stop();
+}
@@ -0,0 +1,132 @@
+#ifndef EPOLL_SERVER_H
+#define EPOLL_SERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <QList>
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "base_server.h"
+
+namespace DataTransfer
+{
+    class EpollServer : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        // Descriptor in the low 32 bits and a per-connection generation in
+        // the high ones, so a handle kept after its connection closed never
+        // reaches a later connection that got the same descriptor.
+        using Handle = quint64;
+
+    signals:
+        void new_connection(Handle handle);
+        void socket_error(Handle handle, int error);
+        void disconnected_socket(Handle handle);
+
+    public:
+        using ReadHandler = std::function<void(Handle handle, const char *data, qint64 size)>;
+        using SlowClientPolicy = BaseServer::SlowClientPolicy;
+
+        EpollServer(const QString &addr,quint16 port);
+        EpollServer(const EpollServer&) = delete;
+        EpollServer(const EpollServer&&) = delete;
+        EpollServer& operator=(const EpollServer&) = delete;
+        EpollServer& operator=(const EpollServer&&) = delete;
+        virtual ~EpollServer();
+
+        bool run();
+        void stop();
+
+        void remove_connection(Handle handle);
+
+        QVector<QPair<QString,quint16>> info_connection();
+        QList<Handle> get_client_sockets() const;
+        int count_connections() const;
+
+        bool write_data(Handle handle, const QByteArray &data, SlowClientPolicy policy = SlowClientPolicy::DROP);
+        int broadcast_data(const QByteArray &data, SlowClientPolicy policy = SlowClientPolicy::SKIP);
+
+        void set_read_handler(ReadHandler handler);
+        void set_max_connections(int count);
+        void set_outbound_limit(qint64 bytes);
+
+        bool is_run()const;
+
+    private:
+        static constexpr int BLOCK_SIZE = 16 * 1024;
+        static constexpr int READ_BUFFER_SIZE = 64 * 1024;
+        static constexpr int MAX_EVENTS = 1024;
+        static constexpr int MAX_FREE_BLOCKS = 4096;
+        static constexpr qint64 DEFAULT_OUTBOUND_LIMIT = 4 * 1024 * 1024;
+
+        struct Block
+        {
+            std::unique_ptr<char[]> data;
+            int begin = 0;
+            int end = 0;
+        };
+
+        struct Connection
+        {
+            int descriptor = -1;
+            Handle handle = 0;
+            bool is_closing = false;
+            QString address;
+            quint16 port = 0;
+            std::mutex mutex;
+            std::deque<Block> outbound;
+            qint64 outbound_bytes = 0;
+        };
+
+        void loop();
+        void accept_connections();
+        void read_connection(Handle handle, int descriptor);
+        bool flush_connection(Connection &connection);
+        void post_close(Handle handle);
+        void close_posted();
+        void close_connection(Handle handle);
+        std::shared_ptr<Connection> find_connection(Handle handle) const;
+
+        Block acquire_block();
+        void release_block(Block &block);
+
+        QString _addr;
+        quint16 _port;
+        int _listen_descriptor;
+        int _epoll_descriptor;
+        int _wakeup_descriptor;
+        int _spare_descriptor;
+        int _max_connections;
+        quint32 _last_generation;
+        std::atomic<qint64> _outbound_limit;
+        std::atomic_bool _is_run;
+        std::atomic_int _count_connections;
+        std::thread _thread;
+        ReadHandler _read_handler;
+
+        mutable std::mutex _connections_mutex;
+        std::vector<std::shared_ptr<Connection>> _connections;
+
+        std::mutex _closes_mutex;
+        std::vector<Handle> _closes;
+
+        std::mutex _blocks_mutex;
+        std::vector<std::unique_ptr<char[]>> _free_blocks;
+
+        std::unique_ptr<char[]> _read_buffer;
+    };
+}
+
+#endif // EPOLL_SERVER_H
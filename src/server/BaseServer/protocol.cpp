@@ -0,0 +1,44 @@
+#include "protocol.h"
+#include "codec.h"
+
+#include <cstring>
+
+namespace dt = DataTransfer;
+
+QByteArray dt::Protocol::encode_frame(quint32 request_id, quint16 type, quint16 flags, const QByteArray &payload)
+{
+    QByteArray frame(HEADER_SIZE + payload.size(), Qt::Uninitialized);
+    char *current = Codec::write_all(frame.data(), static_cast<quint32>(payload.size()), request_id, type, flags);
+    memcpy(current, payload.constData(), static_cast<size_t>(payload.size()));
+    return frame;
+}
+
+// READY once the header is complete; the payload may still be missing.
+dt::Protocol::DecodeResult dt::Protocol::decode_header(const char *data, int size, FrameHeader &header)
+{
+    if(size < HEADER_SIZE)
+    {
+        return DecodeResult::INCOMPLETE;
+    }
+
+    Codec::Reader reader(data, HEADER_SIZE);
+    reader >> header.size >> header.request_id >> header.type >> header.flags;
+    return header.size > MAX_PAYLOAD_SIZE ? DecodeResult::CORRUPTED : DecodeResult::READY;
+}
+
+dt::Protocol::DecodeResult dt::Protocol::decode_frame(const QByteArray &stream, int &offset, FrameHeader &header, QByteArray &payload)
+{
+    auto result = decode_header(stream.constData() + offset, stream.size() - offset, header);
+    if(result != DecodeResult::READY)
+    {
+        return result;
+    }
+    if(static_cast<quint32>(stream.size() - offset - HEADER_SIZE) < header.size)
+    {
+        return DecodeResult::INCOMPLETE;
+    }
+
+    payload = stream.mid(offset + HEADER_SIZE, static_cast<int>(header.size));
+    offset += HEADER_SIZE + static_cast<int>(header.size);
+    return DecodeResult::READY;
+}
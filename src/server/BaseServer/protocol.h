@@ -0,0 +1,48 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+namespace DataTransfer
+{
+    namespace Protocol
+    {
+        enum Flags : quint16
+        {
+            REQUEST = 0x0000,
+            RESPONSE = 0x0001,
+            FAILURE = 0x0002,
+            // Payload is Compression::pack() output; see NEGOTIATE_COMPRESSION.
+            COMPRESSED = 0x0004
+        };
+
+        // Types below 0x0100 belong to the protocol itself.
+        enum ControlType : quint16
+        {
+            // quint8 mask of Compression::Method the peer can decode; the
+            // reply carries the common mask. Any reply after the request may
+            // come COMPRESSED with a method from it.
+            NEGOTIATE_COMPRESSION = 0x0001
+        };
+
+        struct FrameHeader
+        {
+            quint32 size = 0;
+            quint32 request_id = 0;
+            quint16 type = 0;
+            quint16 flags = REQUEST;
+        };
+
+        static constexpr int HEADER_SIZE = 12;
+        static constexpr quint32 MAX_PAYLOAD_SIZE = 64 * 1024 * 1024;
+
+        enum class DecodeResult {INCOMPLETE = 0, READY, CORRUPTED};
+
+        QByteArray encode_frame(quint32 request_id, quint16 type, quint16 flags, const QByteArray &payload);
+        DecodeResult decode_header(const char *data, int size, FrameHeader &header);
+        DecodeResult decode_frame(const QByteArray &stream, int &offset, FrameHeader &header, QByteArray &payload);
+    }
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,356 @@
+#include "request_dispatcher.h"
+
+#include <cstring>
+
+namespace dt = DataTransfer;
+namespace ao = ActiveObject;
+
+namespace
+{
+    class RequestTask : public ao::AbstractTask
+    {
+    public:
+        using Done = std::function<void(bool is_ok, const QByteArray &response)>;
+
+        RequestTask(const dt::RequestDispatcher::Handler &handler, const QByteArray &request,
+                    const dt::BufferSlice &slice, const Done &done):
+            _handler(handler),
+            _request(request),
+            _slice(slice),
+            _done(done)
+        {}
+
+        void run_process() override
+        {
+            QByteArray response;
+            bool is_ok = _handler ? _handler(_request, response) : false;
+            _done(is_ok, response);
+        }
+
+    private:
+        dt::RequestDispatcher::Handler _handler;
+        QByteArray _request;
+        dt::BufferSlice _slice;
+        Done _done;
+    };
+
+    void peek_bytes(const QQueue<dt::BufferSlice> &slices, char *out, int size)
+    {
+        for (auto &slice : slices)
+        {
+            int count = qMin(size, slice.size());
+            memcpy(out, slice.data(), static_cast<size_t>(count));
+            out += count;
+            size -= count;
+            if(size == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // Drops size bytes off the front, copying them to out unless it is null.
+    void take_bytes(QQueue<dt::BufferSlice> &slices, char *out, int size)
+    {
+        while(size > 0)
+        {
+            dt::BufferSlice &head = slices.head();
+            int count = qMin(size, head.size());
+            if(out)
+            {
+                memcpy(out, head.data(), static_cast<size_t>(count));
+                out += count;
+            }
+            size -= count;
+            if(count == head.size())
+            {
+                slices.dequeue();
+            }
+            else
+            {
+                head = head.mid(count);
+            }
+        }
+    }
+}
+
+dt::RequestDispatcher::RequestDispatcher(BaseServer &server, ao::ProxyActiveObject &workers, int max_in_flight, Ordering ordering):
+    _server(server),
+    _workers(workers),
+    _max_in_flight(max_in_flight > 0 ? max_in_flight : DEFAULT_MAX_IN_FLIGHT),
+    _ordering(ordering),
+    _last_id(0),
+    _is_drain_pending(false)
+{
+    _clock.start();
+    connect(&_server, &BaseServer::ready_data_read, this, &RequestDispatcher::process);
+    connect(&_server, &BaseServer::disconnected_socket, this, &RequestDispatcher::release);
+    connect(&_server, &BaseServer::connection_timeout, this, &RequestDispatcher::release);
+
+    register_connection_handler(Protocol::NEGOTIATE_COMPRESSION,
+                                [this](QTcpSocket *socket, const QByteArray &request, QByteArray &response)
+    {
+        return negotiate_compression(socket, request, response);
+    });
+}
+
+// Bulk replies are compressed harder than control ones; see Compression.
+void dt::RequestDispatcher::register_handler(quint16 type, Handler handler, Compression::Traffic traffic)
+{
+    _handlers.insert(type, handler);
+    _traffic.insert(type, traffic);
+}
+
+void dt::RequestDispatcher::register_connection_handler(quint16 type, ConnectionHandler handler)
+{
+    _connection_handlers.insert(type, handler);
+}
+
+void dt::RequestDispatcher::set_max_in_flight(int count)
+{
+    _max_in_flight = count > 0 ? count : DEFAULT_MAX_IN_FLIGHT;
+}
+
+void dt::RequestDispatcher::set_ordering(Ordering ordering)
+{
+    _ordering = ordering;
+}
+
+void dt::RequestDispatcher::process(QTcpSocket *socket)
+{
+    auto it = _connections.find(socket);
+    if(it == _connections.end())
+    {
+        Connection connection;
+        connection.id = ++_last_id;
+        connection.compression = QSharedPointer<Compression>::create();
+        it = _connections.insert(socket, connection);
+    }
+
+    if(it->in_flight < _max_in_flight)
+    {
+        BufferSlice data;
+        while(_server.read_data(socket, data))
+        {
+            it->inbound_size += data.size();
+            if(it->inbound.isEmpty() || !it->inbound.last().extend(data))
+            {
+                it->inbound.enqueue(data);
+            }
+        }
+    }
+    dispatch(socket, *it);
+}
+
+void dt::RequestDispatcher::release(QTcpSocket *socket)
+{
+    _connections.remove(socket);
+}
+
+void dt::RequestDispatcher::dispatch(QTcpSocket *socket, Connection &connection)
+{
+    qint64 now = _clock.nsecsElapsed() / 1000;
+    while(connection.in_flight < _max_in_flight)
+    {
+        Request request;
+        request.received_usec = now;
+        auto result = next_frame(connection, request);
+        if(result == Protocol::DecodeResult::READY && (request.header.flags & Protocol::COMPRESSED))
+        {
+            QByteArray raw;
+            result = connection.compression->unpack(request.payload, raw) ? Protocol::DecodeResult::READY
+                                                                          : Protocol::DecodeResult::CORRUPTED;
+            request.payload = raw;
+            request.slice.clear();
+            request.header.flags &= static_cast<quint16>(~Protocol::COMPRESSED);
+        }
+        if(result == Protocol::DecodeResult::INCOMPLETE)
+        {
+            break;
+        }
+        if(result == Protocol::DecodeResult::CORRUPTED)
+        {
+            _connections.remove(socket);
+            emit protocol_error(socket);
+            _server.remove_connection(socket);
+            return;
+        }
+        _server.record_inbound_message(socket);
+
+        const Protocol::FrameHeader &header = request.header;
+        if(_ordering == Ordering::OUT_OF_ORDER && !_handlers.contains(header.type)
+                && !_connection_handlers.contains(header.type))
+        {
+            _server.queue_data(socket, Protocol::encode_frame(header.request_id, header.type,
+                                                              Protocol::RESPONSE | Protocol::FAILURE, QByteArray()));
+            continue;
+        }
+
+        connection.in_flight++;
+        if(_ordering == Ordering::PER_CONNECTION && connection.is_running)
+        {
+            connection.waiting.enqueue(request);
+        }
+        else
+        {
+            launch(socket, connection, request);
+        }
+    }
+}
+
+// A frame that lies within one read slice is handed out as a view of it, so
+// the bytes read from the socket are not copied again; a frame that straddles
+// slices is copied together.
+dt::Protocol::DecodeResult dt::RequestDispatcher::next_frame(Connection &connection, Request &request)
+{
+    char header[Protocol::HEADER_SIZE];
+    const char *data = nullptr;
+    int size = 0;
+    if(!connection.inbound.isEmpty() && connection.inbound.head().size() >= Protocol::HEADER_SIZE)
+    {
+        data = connection.inbound.head().data();
+        size = connection.inbound.head().size();
+    }
+    else if(connection.inbound_size >= Protocol::HEADER_SIZE)
+    {
+        peek_bytes(connection.inbound, header, Protocol::HEADER_SIZE);
+        data = header;
+        size = Protocol::HEADER_SIZE;
+    }
+
+    auto result = Protocol::decode_header(data, size, request.header);
+    int payload_size = static_cast<int>(request.header.size);
+    if(result != Protocol::DecodeResult::READY || connection.inbound_size < Protocol::HEADER_SIZE + payload_size)
+    {
+        return result == Protocol::DecodeResult::READY ? Protocol::DecodeResult::INCOMPLETE : result;
+    }
+
+    if(connection.inbound.head().size() >= Protocol::HEADER_SIZE + payload_size)
+    {
+        request.slice = connection.inbound.head().mid(Protocol::HEADER_SIZE, payload_size);
+        request.payload = request.slice.raw_data();
+        take_bytes(connection.inbound, nullptr, Protocol::HEADER_SIZE + payload_size);
+    }
+    else
+    {
+        request.payload.resize(payload_size);
+        take_bytes(connection.inbound, nullptr, Protocol::HEADER_SIZE);
+        take_bytes(connection.inbound, request.payload.data(), payload_size);
+    }
+    connection.inbound_size -= Protocol::HEADER_SIZE + payload_size;
+    return Protocol::DecodeResult::READY;
+}
+
+void dt::RequestDispatcher::launch(QTcpSocket *socket, Connection &connection, const Request &request)
+{
+    connection.is_running = true;
+    quint64 id = connection.id;
+    Protocol::FrameHeader header = request.header;
+    qint64 received_usec = request.received_usec;
+    auto done = [this, socket, id, header, received_usec](bool is_ok, const QByteArray &response)
+    {
+        Reply reply;
+        reply.socket = socket;
+        reply.id = id;
+        reply.header = header;
+        reply.is_ok = is_ok;
+        reply.payload = response;
+        reply.received_usec = received_usec;
+        post_reply(std::move(reply));
+    };
+
+    // The reply still goes through the queue so it keeps its place among
+    // the replies of this connection.
+    auto local = _connection_handlers.constFind(header.type);
+    if(local != _connection_handlers.constEnd())
+    {
+        QByteArray response;
+        bool is_ok = local.value()(socket, request.payload, response);
+        done(is_ok, response);
+        return;
+    }
+    _workers.push(new RequestTask(_handlers.value(header.type), request.payload, request.slice, done));
+}
+
+// Runs on the network thread, like encode_reply(), so the methods never
+// change under a reply being packed.
+bool dt::RequestDispatcher::negotiate_compression(QTcpSocket *socket, const QByteArray &request, QByteArray &response)
+{
+    quint8 methods = Compression::NONE;
+    Codec::Reader reader(request);
+    reader >> methods;
+    auto it = _connections.find(socket);
+    if(!reader.is_valid() || it == _connections.end())
+    {
+        return false;
+    }
+    it->compression->negotiate(methods);
+    response = Codec::encode(static_cast<quint8>(Compression::supported_methods() & methods));
+    return true;
+}
+
+QByteArray dt::RequestDispatcher::encode_reply(Connection &connection, const Protocol::FrameHeader &header,
+                                               quint16 flags, const QByteArray &payload)
+{
+    QByteArray packed;
+    if(connection.compression->pack(payload, packed, _traffic.value(header.type, Compression::Traffic::CONTROL)))
+    {
+        return Protocol::encode_frame(header.request_id, header.type, flags | Protocol::COMPRESSED, packed);
+    }
+    return Protocol::encode_frame(header.request_id, header.type, flags, payload);
+}
+
+// Called on worker threads. Only the first reply after a drain queues a wakeup
+// for the network thread; the rest ride along in the same drain.
+void dt::RequestDispatcher::post_reply(Reply reply)
+{
+    _replies.push(std::move(reply));
+    if(!_is_drain_pending.exchange(true, std::memory_order_acq_rel))
+    {
+        QMetaObject::invokeMethod(this, [this]{ drain_replies(); }, Qt::QueuedConnection);
+    }
+}
+
+void dt::RequestDispatcher::drain_replies()
+{
+    _is_drain_pending.store(false, std::memory_order_release);
+
+    QList<QTcpSocket*> resumed;
+    Reply reply;
+    while(_replies.pop(reply))
+    {
+        auto it = _connections.find(reply.socket);
+        if(it == _connections.end() || it->id != reply.id)
+        {
+            continue;
+        }
+
+        it->in_flight--;
+        it->is_running = false;
+        quint16 flags = reply.is_ok ? Protocol::RESPONSE : Protocol::RESPONSE | Protocol::FAILURE;
+        _server.queue_data(reply.socket, encode_reply(*it, reply.header, flags, reply.payload));
+        _server.record_latency(reply.socket, _clock.nsecsElapsed() / 1000 - reply.received_usec);
+
+        if(!it->waiting.isEmpty())
+        {
+            launch(reply.socket, *it, it->waiting.dequeue());
+        }
+        if(!resumed.contains(reply.socket))
+        {
+            resumed.push_back(reply.socket);
+        }
+    }
+
+    for (auto socket : resumed)
+    {
+        if(_connections.contains(socket))
+        {
+            process(socket);
+        }
+    }
+}
+
+dt::RequestDispatcher::~RequestDispatcher()
+{
+
+}
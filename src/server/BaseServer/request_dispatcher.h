@@ -0,0 +1,112 @@
+#ifndef REQUEST_DISPATCHER_H
+#define REQUEST_DISPATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QQueue>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+
+#include <atomic>
+#include <functional>
+
+#include "base_server.h"
+#include "protocol.h"
+#include "compression.h"
+#include "ActiveObject/proxyactiveobject.h"
+#include "ActiveObject/lockfreequeue.h"
+
+namespace DataTransfer
+{
+    class RequestDispatcher : public QObject
+    {
+        Q_OBJECT
+
+    signals:
+        void protocol_error(QTcpSocket *socket);
+
+    public:
+        using Handler = std::function<bool(const QByteArray &request, QByteArray &response)>;
+        // Runs on the network thread with the requesting socket, for requests
+        // that change connection state rather than do work.
+        using ConnectionHandler = std::function<bool(QTcpSocket *socket, const QByteArray &request, QByteArray &response)>;
+
+        enum class Ordering {OUT_OF_ORDER = 0, PER_CONNECTION};
+
+        RequestDispatcher(BaseServer &server, ActiveObject::ProxyActiveObject &workers,
+                          int max_in_flight = DEFAULT_MAX_IN_FLIGHT, Ordering ordering = Ordering::OUT_OF_ORDER);
+        RequestDispatcher(const RequestDispatcher&) = delete;
+        RequestDispatcher(const RequestDispatcher&&) = delete;
+        RequestDispatcher& operator=(const RequestDispatcher&) = delete;
+        RequestDispatcher& operator=(const RequestDispatcher&&) = delete;
+        virtual ~RequestDispatcher();
+
+        void register_handler(quint16 type, Handler handler,
+                              Compression::Traffic traffic = Compression::Traffic::CONTROL);
+        void register_connection_handler(quint16 type, ConnectionHandler handler);
+        void set_max_in_flight(int count);
+        void set_ordering(Ordering ordering);
+
+        void process(QTcpSocket *socket);
+        void release(QTcpSocket *socket);
+
+    private:
+        static constexpr int DEFAULT_MAX_IN_FLIGHT = 64;
+
+        struct Request
+        {
+            Protocol::FrameHeader header;
+            QByteArray payload;
+            // Owns the bytes when payload is a raw view into a read block.
+            BufferSlice slice;
+            qint64 received_usec = 0;
+        };
+
+        struct Reply
+        {
+            QTcpSocket *socket = nullptr;
+            quint64 id = 0;
+            Protocol::FrameHeader header;
+            bool is_ok = false;
+            QByteArray payload;
+            qint64 received_usec = 0;
+        };
+
+        struct Connection
+        {
+            quint64 id = 0;
+            QQueue<BufferSlice> inbound;
+            qint64 inbound_size = 0;
+            int in_flight = 0;
+            bool is_running = false;
+            QQueue<Request> waiting;
+            QSharedPointer<Compression> compression;
+        };
+
+        void dispatch(QTcpSocket *socket, Connection &connection);
+        Protocol::DecodeResult next_frame(Connection &connection, Request &request);
+        void launch(QTcpSocket *socket, Connection &connection, const Request &request);
+        bool negotiate_compression(QTcpSocket *socket, const QByteArray &request, QByteArray &response);
+        QByteArray encode_reply(Connection &connection, const Protocol::FrameHeader &header, quint16 flags, const QByteArray &payload);
+        void post_reply(Reply reply);
+        void drain_replies();
+
+        BaseServer &_server;
+        ActiveObject::ProxyActiveObject &_workers;
+        QHash<quint16,Handler> _handlers;
+        QHash<quint16,ConnectionHandler> _connection_handlers;
+        QHash<quint16,Compression::Traffic> _traffic;
+        QHash<QTcpSocket*,Connection> _connections;
+        int _max_in_flight;
+        Ordering _ordering;
+        quint64 _last_id;
+        QElapsedTimer _clock;
+
+        ActiveObject::LockFreeQueue<Reply> _replies;
+        std::atomic_bool _is_drain_pending;
+    };
+}
+
+#endif // REQUEST_DISPATCHER_H
@@ -0,0 +1,89 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <QtGlobal>
+#include <QVector>
+
+namespace DataTransfer
+{
+    template<typename T>
+    class TimingWheel
+    {
+    public:
+        TimingWheel(int count_slots = DEFAULT_SLOTS, qint64 tick_msec = DEFAULT_TICK_MSEC):
+            _slots(count_slots > 0 ? count_slots : DEFAULT_SLOTS),
+            _tick_msec(tick_msec > 0 ? tick_msec : DEFAULT_TICK_MSEC),
+            _current_tick(-1),
+            _count(0)
+        {}
+
+        void schedule(const T &item, qint64 deadline_msec)
+        {
+            qint64 tick = deadline_msec / _tick_msec;
+            if(tick <= _current_tick)
+            {
+                tick = _current_tick + 1;
+            }
+            _slots[static_cast<int>(tick % _slots.size())].push_back(item);
+            _count++;
+        }
+
+        // Fun returns the next deadline of the item or a negative value to drop it.
+        // Items scheduled more than one revolution ahead are rechecked once per
+        // revolution, so the cost stays O(1) per item per tick.
+        template<typename Fun>
+        void advance(qint64 now_msec, Fun fun)
+        {
+            qint64 target = now_msec / _tick_msec;
+            if(_current_tick < 0 || target - _current_tick > _slots.size())
+            {
+                _current_tick = target - _slots.size();
+            }
+            while(_current_tick < target)
+            {
+                _current_tick++;
+                QVector<T> items;
+                items.swap(_slots[static_cast<int>(_current_tick % _slots.size())]);
+                _count -= items.size();
+                for (const auto &item : items)
+                {
+                    qint64 deadline = fun(item);
+                    if(deadline >= 0)
+                    {
+                        schedule(item, deadline);
+                    }
+                }
+            }
+        }
+
+        int count()const
+        {
+            return _count;
+        }
+
+        void clear()
+        {
+            for (auto &slot : _slots)
+            {
+                slot.clear();
+            }
+            _count = 0;
+        }
+
+        qint64 tick_msec()const
+        {
+            return _tick_msec;
+        }
+
+    private:
+        static constexpr int DEFAULT_SLOTS = 256;
+        static constexpr qint64 DEFAULT_TICK_MSEC = 250;
+
+        QVector<QVector<T>> _slots;
+        qint64 _tick_msec;
+        qint64 _current_tick;
+        int _count;
+    };
+}
+
+#endif // TIMING_WHEEL_H
@@ -0,0 +1,67 @@
+#include "token_bucket.h"
+
+#include <cmath>
+
+namespace dt = DataTransfer;
+
+dt::TokenBucket::TokenBucket(double rate, double burst):
+    _rate(0),
+    _burst(0),
+    _tokens(0),
+    _last_msec(-1)
+{
+    set_rate(rate, burst);
+}
+
+void dt::TokenBucket::set_rate(double rate, double burst)
+{
+    _rate = rate > 0 ? rate : 0;
+    _burst = burst > 0 ? burst : _rate;
+    _tokens = _burst;
+    _last_msec = -1;
+}
+
+bool dt::TokenBucket::is_limited()const
+{
+    return _rate > 0;
+}
+
+void dt::TokenBucket::refill(qint64 now_msec)
+{
+    if(_last_msec >= 0 && now_msec > _last_msec)
+    {
+        _tokens = qMin(_burst, _tokens + _rate * (now_msec - _last_msec) / 1000.0);
+    }
+    _last_msec = now_msec;
+}
+
+bool dt::TokenBucket::can_consume(double amount, qint64 now_msec)
+{
+    if(!is_limited())
+    {
+        return true;
+    }
+    refill(now_msec);
+    return _tokens >= qMin(amount, _burst);
+}
+
+void dt::TokenBucket::consume(double amount, qint64 now_msec)
+{
+    if(!is_limited())
+    {
+        return;
+    }
+    refill(now_msec);
+    _tokens -= amount;
+}
+
+qint64 dt::TokenBucket::delay_msec(double amount, qint64 now_msec)
+{
+    if(!is_limited())
+    {
+        return 0;
+    }
+    refill(now_msec);
+    double missing = qMin(amount, _burst) - _tokens;
+    return missing > 0 ? static_cast<qint64>(std::ceil(missing * 1000.0 / _rate)) : 0;
+}
@@ -0,0 +1,38 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <QtGlobal>
+
+namespace DataTransfer
+{
+    class TokenBucket
+    {
+    public:
+        TokenBucket(double rate = 0, double burst = 0);
+
+        void set_rate(double rate, double burst = 0);
+        bool is_limited()const;
+
+        bool can_consume(double amount, qint64 now_msec);
+        void consume(double amount, qint64 now_msec);
+        qint64 delay_msec(double amount, qint64 now_msec);
+
+    private:
+        void refill(qint64 now_msec);
+
+        double _rate;
+        double _burst;
+        double _tokens;
+        qint64 _last_msec;
+    };
+
+    struct TrafficLimits
+    {
+        TokenBucket inbound_bytes;
+        TokenBucket inbound_messages;
+        TokenBucket outbound_bytes;
+        TokenBucket outbound_messages;
+    };
+}
+
+#endif // TOKEN_BUCKET_H
@@ -0,0 +1,614 @@
+#include "chunk_store.h"
+
+#include "storage_path.h"
+#include "BaseServer/codec.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+namespace dt = DataTransfer;
+
+constexpr quint32 Sync::ChunkStore::MANIFEST_MAGIC;
+constexpr qint64 Sync::ChunkStore::DEFAULT_UNCLAIMED_GRACE_MSEC;
+constexpr qint64 Sync::ChunkStore::DEFAULT_MAX_UNCLAIMED_BYTES;
+
+namespace
+{
+    // FastCDC normalized chunking masks for an 8 KiB average: the stricter
+    // mask applies below the average size, the looser one above it.
+    constexpr quint64 MASK_SMALL = 0x0003590703530000ULL;
+    constexpr quint64 MASK_LARGE = 0x0000D90003530000ULL;
+
+    const char *MANIFEST_SUFFIX = ".manifest";
+
+    // Gear values come from splitmix64 seeded with zero; clients must use
+    // the same table to find the same boundaries.
+    struct GearTable
+    {
+        quint64 values[256];
+
+        GearTable()
+        {
+            quint64 state = 0;
+            for (auto &value : values)
+            {
+                state += 0x9E3779B97F4A7C15ULL;
+                quint64 mixed = state;
+                mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+                value = mixed ^ (mixed >> 31);
+            }
+        }
+    };
+
+    const GearTable GEAR;
+
+    bool is_valid_user(const QString &user)
+    {
+        return !user.isEmpty() && user != "." && user != ".."
+                && !user.contains('/') && !user.contains('\\');
+    }
+}
+
+Sync::ChunkStore::ChunkStore(const QString &root):
+    _root(QDir::cleanPath(root)),
+    _stored_bytes(0),
+    _unclaimed_bytes(0),
+    _unclaimed_grace_msec(DEFAULT_UNCLAIMED_GRACE_MSEC),
+    _max_unclaimed_bytes(DEFAULT_MAX_UNCLAIMED_BYTES),
+    _last_sweep(0)
+{
+    _clock.start();
+}
+
+Sync::ChunkStore::~ChunkStore()
+{}
+
+bool Sync::ChunkStore::open()
+{
+    QMutexLocker lock(&_mutex);
+    _chunks.clear();
+    _unclaimed.clear();
+    _stored_bytes = 0;
+    _unclaimed_bytes = 0;
+    if(!QDir().mkpath(_root + "/chunks") || !QDir().mkpath(_root + "/manifests"))
+    {
+        return false;
+    }
+
+    QDirIterator chunks(_root + "/chunks", QDir::Files, QDirIterator::Subdirectories);
+    while(chunks.hasNext())
+    {
+        chunks.next();
+        ChunkId id = QByteArray::fromHex(chunks.fileName().toLatin1());
+        if(id.size() != ID_SIZE)
+        {
+            continue;
+        }
+        Chunk chunk;
+        chunk.size = static_cast<qint32>(chunks.fileInfo().size());
+        _chunks.insert(id, chunk);
+    }
+
+    QDirIterator manifests(_root + "/manifests", {QString("*") + MANIFEST_SUFFIX}, QDir::Files, QDirIterator::Subdirectories);
+    while(manifests.hasNext())
+    {
+        Manifest manifest;
+        if(!load_manifest(manifests.next(), manifest))
+        {
+            continue;
+        }
+        for (auto &id : manifest)
+        {
+            auto it = _chunks.find(id);
+            if(it != _chunks.end())
+            {
+                it->refs++;
+            }
+        }
+    }
+
+    for (auto it = _chunks.begin(); it != _chunks.end();)
+    {
+        if(it->refs == 0)
+        {
+            QFile::remove(chunk_path(it.key()));
+            it = _chunks.erase(it);
+            continue;
+        }
+        _stored_bytes += it->size;
+        ++it;
+    }
+    return true;
+}
+
+void Sync::ChunkStore::register_handlers(dt::RequestDispatcher &dispatcher)
+{
+    auto read_manifest_ids = [](const QByteArray &request, dt::Codec::Reader &reader, Manifest &manifest)
+    {
+        qint32 count = 0;
+        reader >> count;
+        if(!reader.is_valid() || count < 0 || count > request.size() / ID_SIZE)
+        {
+            return false;
+        }
+        manifest.reserve(count);
+        for (qint32 i = 0; i < count && reader.is_valid(); i++)
+        {
+            ChunkId id;
+            reader >> id;
+            manifest.push_back(id);
+        }
+        return reader.is_valid();
+    };
+
+    auto encode_ids = [](const Manifest &manifest)
+    {
+        QByteArray data;
+        data.reserve(4 + manifest.size() * (ID_SIZE + 4));
+        dt::Codec::append(data, static_cast<qint32>(manifest.size()));
+        for (auto &id : manifest)
+        {
+            dt::Codec::append(data, id);
+        }
+        return data;
+    };
+
+    dispatcher.register_handler(QUERY_CHUNKS, [this, read_manifest_ids, encode_ids](const QByteArray &request, QByteArray &response)
+    {
+        Manifest manifest;
+        dt::Codec::Reader reader(request);
+        if(!read_manifest_ids(request, reader, manifest))
+        {
+            return false;
+        }
+        response = encode_ids(missing_chunks(manifest));
+        return true;
+    });
+
+    dispatcher.register_handler(PUT_CHUNK, [this](const QByteArray &request, QByteArray &response)
+    {
+        QByteArray data;
+        dt::Codec::Reader reader(request);
+        reader >> data;
+        ChunkId id;
+        if(!reader.is_valid() || !put_chunk(data, id))
+        {
+            return false;
+        }
+        response = dt::Codec::encode(id);
+        return true;
+    });
+
+    dispatcher.register_handler(GET_CHUNK, [this](const QByteArray &request, QByteArray &response)
+    {
+        ChunkId id;
+        dt::Codec::Reader reader(request);
+        reader >> id;
+        QByteArray data;
+        if(!reader.is_valid() || !read_chunk(id, data))
+        {
+            return false;
+        }
+        response = dt::Codec::encode(data);
+        return true;
+    }, dt::Compression::Traffic::BULK);
+
+    dispatcher.register_handler(COMMIT_MANIFEST, [this, read_manifest_ids](const QByteArray &request, QByteArray &)
+    {
+        QString user;
+        QString path;
+        Manifest manifest;
+        dt::Codec::Reader reader(request);
+        reader >> user >> path;
+        return reader.is_valid() && read_manifest_ids(request, reader, manifest) && commit_manifest(user, path, manifest);
+    });
+
+    dispatcher.register_handler(GET_MANIFEST, [this, encode_ids](const QByteArray &request, QByteArray &response)
+    {
+        QString user;
+        QString path;
+        dt::Codec::Reader reader(request);
+        reader >> user >> path;
+        Manifest manifest;
+        if(!reader.is_valid() || !read_manifest(user, path, manifest))
+        {
+            return false;
+        }
+        response = encode_ids(manifest);
+        return true;
+    });
+
+    dispatcher.register_handler(REMOVE_MANIFEST, [this](const QByteArray &request, QByteArray &)
+    {
+        QString user;
+        QString path;
+        dt::Codec::Reader reader(request);
+        reader >> user >> path;
+        return reader.is_valid() && remove_manifest(user, path);
+    });
+}
+
+// FastCDC: skip MIN_CHUNK_SIZE bytes, then roll a gear hash and cut where the
+// masked bits are zero. The stricter mask before the average size and the
+// looser one after it pull chunk sizes towards the average.
+int Sync::ChunkStore::next_boundary(const char *data, int size)
+{
+    if(size <= MIN_CHUNK_SIZE)
+    {
+        return size;
+    }
+
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    int limit = qMin(size, static_cast<int>(MAX_CHUNK_SIZE));
+    int normal = qMin(limit, static_cast<int>(AVERAGE_CHUNK_SIZE));
+    quint64 hash = 0;
+    int i = MIN_CHUNK_SIZE;
+
+    for (; i < normal; i++)
+    {
+        hash = (hash << 1) + GEAR.values[bytes[i]];
+        if(!(hash & MASK_SMALL))
+        {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++)
+    {
+        hash = (hash << 1) + GEAR.values[bytes[i]];
+        if(!(hash & MASK_LARGE))
+        {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+Sync::ChunkStore::ChunkId Sync::ChunkStore::chunk_id(const char *data, int size)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, size), QCryptographicHash::Sha256);
+}
+
+Sync::ChunkStore::Manifest Sync::ChunkStore::missing_chunks(const Manifest &manifest) const
+{
+    Manifest missing;
+    QSet<ChunkId> seen;
+    QMutexLocker lock(&_mutex);
+    for (auto &id : manifest)
+    {
+        if(!_chunks.contains(id) && !seen.contains(id))
+        {
+            seen.insert(id);
+            missing.push_back(id);
+        }
+    }
+    return missing;
+}
+
+// A new chunk starts with no references; commit_manifest() claims it. Its
+// size is reserved against the unclaimed cap before the file is written.
+bool Sync::ChunkStore::put_chunk(const QByteArray &data, ChunkId &id)
+{
+    if(data.isEmpty() || data.size() > MAX_CHUNK_SIZE)
+    {
+        return false;
+    }
+    id = chunk_id(data.constData(), data.size());
+
+    {
+        QMutexLocker lock(&_mutex);
+        if(_chunks.contains(id))
+        {
+            return true;
+        }
+        bool is_full = _max_unclaimed_bytes > 0 && _unclaimed_bytes + data.size() > _max_unclaimed_bytes;
+        sweep_unclaimed(_clock.elapsed(), is_full);
+        if(_max_unclaimed_bytes > 0 && _unclaimed_bytes + data.size() > _max_unclaimed_bytes)
+        {
+            return false;
+        }
+        _unclaimed_bytes += data.size();
+    }
+
+    QString path = chunk_path(id);
+    QSaveFile file(path);
+    bool is_ok = QDir().mkpath(QFileInfo(path).absolutePath()) && file.open(QIODevice::WriteOnly)
+            && file.write(data) == data.size() && file.commit();
+
+    QMutexLocker lock(&_mutex);
+    if(!is_ok || _chunks.contains(id))
+    {
+        _unclaimed_bytes -= data.size();
+        return is_ok;
+    }
+    Chunk chunk;
+    chunk.size = data.size();
+    _chunks.insert(id, chunk);
+    _unclaimed.insert(id, _clock.elapsed());
+    return true;
+}
+
+bool Sync::ChunkStore::read_chunk(const ChunkId &id, QByteArray &data) const
+{
+    if(id.size() != ID_SIZE)
+    {
+        return false;
+    }
+    QFile file(chunk_path(id));
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    data = file.readAll();
+    return !data.isEmpty();
+}
+
+// Only the reference counts are updated under the store-wide mutex. Writers
+// of the same manifest file line up on its path stripe instead, so reading
+// the previous manifest and replacing it cannot interleave. The new chunks
+// are claimed before the file is written so no sweep or release can delete
+// them meanwhile.
+bool Sync::ChunkStore::commit_manifest(const QString &user, const QString &path, const Manifest &manifest)
+{
+    QString target;
+    if(!manifest_path(user, path, target))
+    {
+        return false;
+    }
+
+    QMutexLocker path_lock(&path_mutex(target));
+    {
+        QMutexLocker lock(&_mutex);
+        for (auto &id : manifest)
+        {
+            if(!_chunks.contains(id))
+            {
+                return false;
+            }
+        }
+        claim_chunks(manifest);
+    }
+
+    QByteArray data;
+    data.reserve(8 + manifest.size() * (ID_SIZE + 4));
+    dt::Codec::append(data, MANIFEST_MAGIC, static_cast<qint32>(manifest.size()));
+    for (auto &id : manifest)
+    {
+        dt::Codec::append(data, id);
+    }
+
+    Manifest previous;
+    bool has_previous = load_manifest(target, previous);
+    QSaveFile file(target);
+    bool is_ok = QDir().mkpath(QFileInfo(target).absolutePath()) && file.open(QIODevice::WriteOnly)
+            && file.write(data) == data.size() && file.commit();
+
+    QMutexLocker lock(&_mutex);
+    if(!is_ok)
+    {
+        release_chunks(manifest);
+        return false;
+    }
+    if(has_previous)
+    {
+        release_chunks(previous);
+    }
+    return true;
+}
+
+bool Sync::ChunkStore::read_manifest(const QString &user, const QString &path, Manifest &manifest) const
+{
+    QString target;
+    return manifest_path(user, path, target) && load_manifest(target, manifest);
+}
+
+bool Sync::ChunkStore::remove_manifest(const QString &user, const QString &path)
+{
+    QString target;
+    if(!manifest_path(user, path, target))
+    {
+        return false;
+    }
+
+    QMutexLocker path_lock(&path_mutex(target));
+    Manifest manifest;
+    if(!load_manifest(target, manifest) || !QFile::remove(target))
+    {
+        return false;
+    }
+    QMutexLocker lock(&_mutex);
+    release_chunks(manifest);
+    return true;
+}
+
+bool Sync::ChunkStore::store_file(const QString &user, const QString &path, QIODevice &source)
+{
+    Manifest manifest;
+    QByteArray buffer;
+    bool is_end = false;
+    while(!is_end || !buffer.isEmpty())
+    {
+        if(!is_end && buffer.size() < MAX_CHUNK_SIZE)
+        {
+            QByteArray data = source.read(16 * MAX_CHUNK_SIZE);
+            is_end = data.isEmpty();
+            buffer.append(data);
+            continue;
+        }
+
+        int length = next_boundary(buffer.constData(), buffer.size());
+        ChunkId id;
+        if(!put_chunk(buffer.left(length), id))
+        {
+            return false;
+        }
+        manifest.push_back(id);
+        buffer.remove(0, length);
+    }
+    return commit_manifest(user, path, manifest);
+}
+
+bool Sync::ChunkStore::restore_file(const QString &user, const QString &path, QIODevice &out) const
+{
+    Manifest manifest;
+    if(!read_manifest(user, path, manifest))
+    {
+        return false;
+    }
+    for (auto &id : manifest)
+    {
+        QByteArray data;
+        if(!read_chunk(id, data) || out.write(data) != data.size())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 Sync::ChunkStore::count_chunks() const
+{
+    QMutexLocker lock(&_mutex);
+    return _chunks.size();
+}
+
+qint64 Sync::ChunkStore::stored_bytes() const
+{
+    QMutexLocker lock(&_mutex);
+    return _stored_bytes;
+}
+
+qint64 Sync::ChunkStore::unclaimed_bytes() const
+{
+    QMutexLocker lock(&_mutex);
+    return _unclaimed_bytes;
+}
+
+void Sync::ChunkStore::set_unclaimed_limits(qint64 grace_msec, qint64 max_bytes)
+{
+    QMutexLocker lock(&_mutex);
+    _unclaimed_grace_msec = qMax<qint64>(0, grace_msec);
+    _max_unclaimed_bytes = qMax<qint64>(0, max_bytes);
+}
+
+void Sync::ChunkStore::reclaim_unclaimed()
+{
+    QMutexLocker lock(&_mutex);
+    sweep_unclaimed(_clock.elapsed(), true);
+}
+
+QString Sync::ChunkStore::chunk_path(const ChunkId &id) const
+{
+    QString hex = QString::fromLatin1(id.toHex());
+    return _root + "/chunks/" + hex.left(2) + "/" + hex;
+}
+
+bool Sync::ChunkStore::manifest_path(const QString &user, const QString &path, QString &target) const
+{
+    if(!is_valid_user(user) || !resolve_storage_path(_root + "/manifests/" + user, path, target))
+    {
+        return false;
+    }
+    target += MANIFEST_SUFFIX;
+    return true;
+}
+
+bool Sync::ChunkStore::load_manifest(const QString &file_name, Manifest &manifest) const
+{
+    QFile file(file_name);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    dt::Codec::Reader reader(data);
+    quint32 magic = 0;
+    qint32 count = 0;
+    reader >> magic >> count;
+    if(!reader.is_valid() || magic != MANIFEST_MAGIC || count < 0 || count > data.size() / ID_SIZE)
+    {
+        return false;
+    }
+
+    manifest.clear();
+    manifest.reserve(count);
+    for (qint32 i = 0; i < count; i++)
+    {
+        ChunkId id;
+        if(!reader.read(id) || id.size() != ID_SIZE)
+        {
+            return false;
+        }
+        manifest.push_back(id);
+    }
+    return reader.at_end();
+}
+
+QMutex &Sync::ChunkStore::path_mutex(const QString &target)
+{
+    return _path_mutexes[qHash(target) % PATH_STRIPES];
+}
+
+void Sync::ChunkStore::claim_chunks(const Manifest &manifest)
+{
+    for (auto &id : manifest)
+    {
+        auto &chunk = _chunks[id];
+        if(chunk.refs++ == 0)
+        {
+            _stored_bytes += chunk.size;
+            if(_unclaimed.remove(id))
+            {
+                _unclaimed_bytes -= chunk.size;
+            }
+        }
+    }
+}
+
+// Deletes the chunks that stayed unclaimed past the grace period. Without
+// is_forced the walk runs at most a few times per grace period.
+void Sync::ChunkStore::sweep_unclaimed(qint64 now, bool is_forced)
+{
+    if(_unclaimed.isEmpty() || (!is_forced && now - _last_sweep < _unclaimed_grace_msec / 8))
+    {
+        return;
+    }
+    _last_sweep = now;
+    for (auto it = _unclaimed.begin(); it != _unclaimed.end();)
+    {
+        if(now - it.value() < _unclaimed_grace_msec)
+        {
+            ++it;
+            continue;
+        }
+        auto chunk = _chunks.find(it.key());
+        if(chunk != _chunks.end() && chunk->refs == 0)
+        {
+            _unclaimed_bytes -= chunk->size;
+            QFile::remove(chunk_path(it.key()));
+            _chunks.erase(chunk);
+        }
+        it = _unclaimed.erase(it);
+    }
+}
+
+void Sync::ChunkStore::release_chunks(const Manifest &manifest)
+{
+    for (auto &id : manifest)
+    {
+        auto it = _chunks.find(id);
+        if(it == _chunks.end() || --it->refs > 0)
+        {
+            continue;
+        }
+        _stored_bytes -= it->size;
+        QFile::remove(chunk_path(id));
+        _chunks.erase(it);
+    }
+}
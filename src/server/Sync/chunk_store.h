@@ -0,0 +1,101 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QIODevice>
+#include <QElapsedTimer>
+
+#include "BaseServer/request_dispatcher.h"
+#include "sync_messages.h"
+
+namespace Sync
+{
+    // Content-addressed store of FastCDC chunks shared by all users. A stored
+    // file is a manifest (ordered list of SHA-256 chunk ids); chunks are
+    // reference counted by the manifests that use them and deleted with the
+    // last one. Manifests on disk are the source of truth: open() rebuilds
+    // the counts and drops chunks nothing refers to. A chunk no manifest has
+    // claimed yet is kept for a grace period, and the bytes held by such
+    // chunks are capped so PUT_CHUNK alone cannot fill the disk.
+    class ChunkStore
+    {
+    public:
+        static constexpr int MIN_CHUNK_SIZE = 2 * 1024;
+        static constexpr int AVERAGE_CHUNK_SIZE = 8 * 1024;
+        static constexpr int MAX_CHUNK_SIZE = 64 * 1024;
+        static constexpr int ID_SIZE = 32;
+        static constexpr qint64 DEFAULT_UNCLAIMED_GRACE_MSEC = 60 * 60 * 1000;
+        static constexpr qint64 DEFAULT_MAX_UNCLAIMED_BYTES = 1024LL * 1024 * 1024;
+
+        using ChunkId = QByteArray;
+        using Manifest = QVector<ChunkId>;
+
+        explicit ChunkStore(const QString &root);
+        ChunkStore(const ChunkStore&) = delete;
+        ChunkStore(const ChunkStore&&) = delete;
+        ChunkStore& operator=(const ChunkStore&) = delete;
+        ChunkStore& operator=(const ChunkStore&&) = delete;
+        virtual ~ChunkStore();
+
+        bool open();
+        void register_handlers(DataTransfer::RequestDispatcher &dispatcher);
+
+        // max_bytes 0 leaves the unclaimed bytes unbounded.
+        void set_unclaimed_limits(qint64 grace_msec, qint64 max_bytes);
+        void reclaim_unclaimed();
+
+        static int next_boundary(const char *data, int size);
+        static ChunkId chunk_id(const char *data, int size);
+
+        Manifest missing_chunks(const Manifest &manifest) const;
+        bool put_chunk(const QByteArray &data, ChunkId &id);
+        bool read_chunk(const ChunkId &id, QByteArray &data) const;
+
+        bool commit_manifest(const QString &user, const QString &path, const Manifest &manifest);
+        bool read_manifest(const QString &user, const QString &path, Manifest &manifest) const;
+        bool remove_manifest(const QString &user, const QString &path);
+
+        bool store_file(const QString &user, const QString &path, QIODevice &source);
+        bool restore_file(const QString &user, const QString &path, QIODevice &out) const;
+
+        qint64 count_chunks() const;
+        qint64 stored_bytes() const;
+        qint64 unclaimed_bytes() const;
+
+    private:
+        struct Chunk
+        {
+            qint32 size = 0;
+            qint64 refs = 0;
+        };
+
+        static constexpr quint32 MANIFEST_MAGIC = 0x434D4631;
+        static constexpr int PATH_STRIPES = 64;
+
+        QString chunk_path(const ChunkId &id) const;
+        bool manifest_path(const QString &user, const QString &path, QString &target) const;
+        bool load_manifest(const QString &file_name, Manifest &manifest) const;
+        void release_chunks(const Manifest &manifest);
+        void claim_chunks(const Manifest &manifest);
+        void sweep_unclaimed(qint64 now, bool is_forced);
+        QMutex &path_mutex(const QString &target);
+
+        QString _root;
+        mutable QMutex _mutex;
+        QMutex _path_mutexes[PATH_STRIPES];
+        QHash<ChunkId,Chunk> _chunks;
+        QHash<ChunkId,qint64> _unclaimed;
+        qint64 _stored_bytes;
+        qint64 _unclaimed_bytes;
+        qint64 _unclaimed_grace_msec;
+        qint64 _max_unclaimed_bytes;
+        qint64 _last_sweep;
+        QElapsedTimer _clock;
+    };
+}
+
+#endif // CHUNK_STORE_H
@@ -0,0 +1,398 @@
+#include "chunked_transfer.h"
+
+#include "xxhash64.h"
+#include "storage_path.h"
+#include "BaseServer/codec.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace dt = DataTransfer;
+
+constexpr quint32 Sync::ChunkedTransfer::STATE_MAGIC;
+
+static_assert(Sync::ChunkedTransfer::MAX_CHUNK_COUNT / 8 + 64 <= dt::Protocol::MAX_PAYLOAD_SIZE,
+              "upload progress must fit in one frame");
+
+namespace
+{
+    qint32 count_chunks(qint64 size, qint32 chunk_size)
+    {
+        return static_cast<qint32>((size + chunk_size - 1) / chunk_size);
+    }
+
+    qint64 chunk_length(qint64 size, qint32 chunk_size, qint32 index)
+    {
+        return qMin<qint64>(chunk_size, size - static_cast<qint64>(index) * chunk_size);
+    }
+
+    // Replaces to in one step, so a failure leaves both files as they were.
+    bool replace_file(const QString &from, const QString &to)
+    {
+#ifdef Q_OS_WIN
+        return MoveFileExW(reinterpret_cast<LPCWSTR>(from.utf16()), reinterpret_cast<LPCWSTR>(to.utf16()),
+                           MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+    }
+}
+
+Sync::ChunkedTransfer::ChunkedTransfer(const QString &root):
+    _root(QDir::cleanPath(root))
+{}
+
+Sync::ChunkedTransfer::~ChunkedTransfer()
+{}
+
+void Sync::ChunkedTransfer::register_handlers(dt::RequestDispatcher &dispatcher)
+{
+    auto encode_progress = [](const Progress &progress)
+    {
+        return dt::Codec::encode(progress.count, progress.count_done, progress.first_missing, progress.bitmap);
+    };
+
+    dispatcher.register_handler(BEGIN_UPLOAD, [this, encode_progress](const QByteArray &request, QByteArray &response)
+    {
+        QString path;
+        qint64 size = 0;
+        qint32 chunk_size = 0;
+        dt::Codec::Reader reader(request);
+        reader >> path >> size >> chunk_size;
+        Progress progress;
+        if(!reader.is_valid() || !begin_upload(path, size, chunk_size, progress))
+        {
+            return false;
+        }
+        response = encode_progress(progress);
+        return true;
+    });
+
+    dispatcher.register_handler(UPLOAD_CHUNK, [this](const QByteArray &request, QByteArray &)
+    {
+        QString path;
+        qint32 index = 0;
+        quint64 hash = 0;
+        QByteArray data;
+        dt::Codec::Reader reader(request);
+        reader >> path >> index >> hash >> data;
+        return reader.is_valid() && write_chunk(path, index, hash, data);
+    });
+
+    dispatcher.register_handler(UPLOAD_STATUS, [this, encode_progress](const QByteArray &request, QByteArray &response)
+    {
+        QString path;
+        dt::Codec::Reader reader(request);
+        reader >> path;
+        Progress progress;
+        if(!reader.is_valid() || !upload_status(path, progress))
+        {
+            return false;
+        }
+        response = encode_progress(progress);
+        return true;
+    });
+
+    dispatcher.register_handler(FINISH_UPLOAD, [this](const QByteArray &request, QByteArray &)
+    {
+        QString path;
+        dt::Codec::Reader reader(request);
+        reader >> path;
+        return reader.is_valid() && finish_upload(path);
+    });
+
+    dispatcher.register_handler(READ_CHUNK, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString path;
+        qint32 chunk_size = 0;
+        qint32 index = 0;
+        dt::Codec::Reader reader(request);
+        reader >> path >> chunk_size >> index;
+        QByteArray data;
+        quint64 hash = 0;
+        if(!reader.is_valid() || !read_chunk(path, chunk_size, index, data, hash))
+        {
+            return false;
+        }
+        response = dt::Codec::encode(hash, data);
+        return true;
+    }, dt::Compression::Traffic::BULK);
+}
+
+bool Sync::ChunkedTransfer::begin_upload(const QString &path, qint64 size, qint32 chunk_size, Progress &progress)
+{
+    QString target;
+    chunk_size = chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE;
+    if(!resolve_storage_path(_root, path, target) || size < 0 || chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE
+            || size > static_cast<qint64>(MAX_CHUNK_COUNT) * chunk_size)
+    {
+        return false;
+    }
+
+    QMutexLocker lock(&_mutex);
+    auto upload = _uploads.value(target);
+    if(!upload)
+    {
+        upload = QSharedPointer<Upload>::create();
+        if(!load_upload(target, *upload))
+        {
+            upload.clear();
+        }
+    }
+
+    if(upload)
+    {
+        QMutexLocker upload_lock(&upload->mutex);
+        if(upload->size == size && upload->chunk_size == chunk_size)
+        {
+            _uploads.insert(target, upload);
+            fill_progress(*upload, progress);
+            return true;
+        }
+        // Same path with a different shape: the old partial data is useless.
+        upload->data.close();
+        upload->state.close();
+        _uploads.remove(target);
+    }
+
+    upload = QSharedPointer<Upload>::create();
+    if(!create_upload(target, size, chunk_size, *upload))
+    {
+        return false;
+    }
+    _uploads.insert(target, upload);
+    fill_progress(*upload, progress);
+    return true;
+}
+
+bool Sync::ChunkedTransfer::write_chunk(const QString &path, qint32 index, quint64 hash, const QByteArray &data)
+{
+    QString target;
+    if(!resolve_storage_path(_root, path, target))
+    {
+        return false;
+    }
+    auto upload = find_upload(target);
+    if(!upload)
+    {
+        return false;
+    }
+
+    {
+        QMutexLocker lock(&upload->mutex);
+        if(index < 0 || index >= upload->count
+                || data.size() != chunk_length(upload->size, upload->chunk_size, index))
+        {
+            return false;
+        }
+    }
+
+    // Hash outside the lock so chunks of one file verify in parallel.
+    if(xxhash64(data) != hash)
+    {
+        return false;
+    }
+
+    QMutexLocker lock(&upload->mutex);
+    if(!upload->data.isOpen())
+    {
+        return false;
+    }
+    char &byte = upload->bitmap.data()[index / 8];
+    char bit = static_cast<char>(1 << (index % 8));
+    if(byte & bit)
+    {
+        return true;
+    }
+
+    if(!upload->data.seek(static_cast<qint64>(index) * upload->chunk_size)
+            || upload->data.write(data) != data.size()
+            || !upload->data.flush())
+    {
+        return false;
+    }
+
+    byte = static_cast<char>(byte | bit);
+    upload->count_done++;
+    return upload->state.seek(STATE_HEADER_SIZE + index / 8)
+            && upload->state.write(&byte, 1) == 1
+            && upload->state.flush();
+}
+
+bool Sync::ChunkedTransfer::upload_status(const QString &path, Progress &progress)
+{
+    QString target;
+    if(!resolve_storage_path(_root, path, target))
+    {
+        return false;
+    }
+    auto upload = find_upload(target);
+    if(!upload)
+    {
+        return false;
+    }
+    QMutexLocker lock(&upload->mutex);
+    fill_progress(*upload, progress);
+    return true;
+}
+
+bool Sync::ChunkedTransfer::finish_upload(const QString &path)
+{
+    QString target;
+    if(!resolve_storage_path(_root, path, target))
+    {
+        return false;
+    }
+    auto upload = find_upload(target);
+    if(!upload)
+    {
+        return false;
+    }
+
+    QMutexLocker lock(&_mutex);
+    QMutexLocker upload_lock(&upload->mutex);
+    if(!upload->data.isOpen() || upload->count_done != upload->count)
+    {
+        return false;
+    }
+
+    // If the rename fails the part and state files are still on disk, and
+    // the next request for the path loads them again.
+    upload->data.close();
+    upload->state.close();
+    _uploads.remove(target);
+    if(!replace_file(target + PART_SUFFIX, target))
+    {
+        return false;
+    }
+    QFile::remove(target + STATE_SUFFIX);
+    return true;
+}
+
+bool Sync::ChunkedTransfer::read_chunk(const QString &path, qint32 chunk_size, qint32 index, QByteArray &data, quint64 &hash) const
+{
+    QString target;
+    chunk_size = chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE;
+    if(!resolve_storage_path(_root, path, target) || index < 0 || chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE)
+    {
+        return false;
+    }
+
+    QFile file(target);
+    if(!file.open(QIODevice::ReadOnly) || !file.seek(static_cast<qint64>(index) * chunk_size))
+    {
+        return false;
+    }
+    data = file.read(chunk_size);
+    if(data.isEmpty() && file.size() > 0)
+    {
+        return false;
+    }
+    hash = xxhash64(data);
+    return true;
+}
+
+QSharedPointer<Sync::ChunkedTransfer::Upload> Sync::ChunkedTransfer::find_upload(const QString &target)
+{
+    QMutexLocker lock(&_mutex);
+    auto upload = _uploads.value(target);
+    if(!upload)
+    {
+        upload = QSharedPointer<Upload>::create();
+        if(!load_upload(target, *upload))
+        {
+            return QSharedPointer<Upload>();
+        }
+        _uploads.insert(target, upload);
+    }
+    return upload;
+}
+
+bool Sync::ChunkedTransfer::load_upload(const QString &target, Upload &upload) const
+{
+    upload.data.setFileName(target + PART_SUFFIX);
+    upload.state.setFileName(target + STATE_SUFFIX);
+    if(!upload.data.exists() || !upload.state.open(QIODevice::ReadWrite))
+    {
+        return false;
+    }
+
+    QByteArray header = upload.state.read(STATE_HEADER_SIZE);
+    quint32 magic = 0;
+    dt::Codec::Reader reader(header);
+    reader >> magic >> upload.size >> upload.chunk_size;
+    if(!reader.is_valid() || magic != STATE_MAGIC || upload.size < 0
+            || upload.chunk_size < MIN_CHUNK_SIZE || upload.chunk_size > MAX_CHUNK_SIZE
+            || upload.size > static_cast<qint64>(MAX_CHUNK_COUNT) * upload.chunk_size)
+    {
+        upload.state.close();
+        return false;
+    }
+
+    upload.count = count_chunks(upload.size, upload.chunk_size);
+    upload.bitmap = upload.state.read((upload.count + 7) / 8);
+    if(upload.bitmap.size() != (upload.count + 7) / 8 || !upload.data.open(QIODevice::ReadWrite))
+    {
+        upload.state.close();
+        return false;
+    }
+
+    upload.count_done = 0;
+    for (qint32 i = 0; i < upload.count; i++)
+    {
+        if(upload.bitmap.at(i / 8) & (1 << (i % 8)))
+        {
+            upload.count_done++;
+        }
+    }
+    return true;
+}
+
+bool Sync::ChunkedTransfer::create_upload(const QString &target, qint64 size, qint32 chunk_size, Upload &upload) const
+{
+    if(!QDir().mkpath(QFileInfo(target).absolutePath()))
+    {
+        return false;
+    }
+
+    upload.size = size;
+    upload.chunk_size = chunk_size;
+    upload.count = count_chunks(size, chunk_size);
+    upload.count_done = 0;
+    upload.bitmap = QByteArray((upload.count + 7) / 8, 0);
+
+    upload.data.setFileName(target + PART_SUFFIX);
+    upload.state.setFileName(target + STATE_SUFFIX);
+    if(!upload.data.open(QIODevice::ReadWrite | QIODevice::Truncate) || !upload.data.resize(size)
+            || !upload.state.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        upload.data.close();
+        return false;
+    }
+
+    QByteArray header = dt::Codec::encode(STATE_MAGIC, size, chunk_size);
+    return upload.state.write(header + upload.bitmap) == header.size() + upload.bitmap.size()
+            && upload.state.flush();
+}
+
+void Sync::ChunkedTransfer::fill_progress(const Upload &upload, Progress &progress) const
+{
+    progress.count = upload.count;
+    progress.count_done = upload.count_done;
+    progress.bitmap = upload.bitmap;
+    progress.first_missing = upload.count;
+    for (qint32 i = 0; i < upload.count; i++)
+    {
+        if(!(upload.bitmap.at(i / 8) & (1 << (i % 8))))
+        {
+            progress.first_missing = i;
+            break;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef CHUNKED_TRANSFER_H
+#define CHUNKED_TRANSFER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QFile>
+#include <QSharedPointer>
+
+#include "BaseServer/request_dispatcher.h"
+#include "sync_messages.h"
+
+namespace Sync
+{
+    // Uploads are written to "<path>.part" next to a "<path>.part.state" file
+    // holding one bit per completed chunk, so a transfer interrupted by a
+    // dropped connection or a restart resumes from the first missing chunk.
+    // Chunks may arrive in any order and from several connections at once.
+    class ChunkedTransfer
+    {
+    public:
+        static constexpr qint32 DEFAULT_CHUNK_SIZE = 1024 * 1024;
+        static constexpr qint32 MIN_CHUNK_SIZE = 4 * 1024;
+        static constexpr qint32 MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+        // Keeps the progress bitmap at 128 KiB, so UPLOAD_STATUS always fits
+        // one frame; at the default chunk size that allows 1 TiB per file.
+        static constexpr qint32 MAX_CHUNK_COUNT = 1024 * 1024;
+
+        struct Progress
+        {
+            qint32 count = 0;
+            qint32 count_done = 0;
+            qint32 first_missing = 0;
+            QByteArray bitmap;
+        };
+
+        explicit ChunkedTransfer(const QString &root);
+        ChunkedTransfer(const ChunkedTransfer&) = delete;
+        ChunkedTransfer(const ChunkedTransfer&&) = delete;
+        ChunkedTransfer& operator=(const ChunkedTransfer&) = delete;
+        ChunkedTransfer& operator=(const ChunkedTransfer&&) = delete;
+        virtual ~ChunkedTransfer();
+
+        void register_handlers(DataTransfer::RequestDispatcher &dispatcher);
+
+        bool begin_upload(const QString &path, qint64 size, qint32 chunk_size, Progress &progress);
+        bool write_chunk(const QString &path, qint32 index, quint64 hash, const QByteArray &data);
+        bool upload_status(const QString &path, Progress &progress);
+        bool finish_upload(const QString &path);
+        bool read_chunk(const QString &path, qint32 chunk_size, qint32 index, QByteArray &data, quint64 &hash) const;
+
+    private:
+        struct Upload
+        {
+            QMutex mutex;
+            QFile data;
+            QFile state;
+            qint64 size = 0;
+            qint32 chunk_size = 0;
+            qint32 count = 0;
+            qint32 count_done = 0;
+            QByteArray bitmap;
+        };
+
+        static constexpr quint32 STATE_MAGIC = 0x43545331;
+        static constexpr int STATE_HEADER_SIZE = 16;
+
+        QSharedPointer<Upload> find_upload(const QString &target);
+        bool load_upload(const QString &target, Upload &upload) const;
+        bool create_upload(const QString &target, qint64 size, qint32 chunk_size, Upload &upload) const;
+        void fill_progress(const Upload &upload, Progress &progress) const;
+
+        QString _root;
+        QMutex _mutex;
+        QHash<QString,QSharedPointer<Upload>> _uploads;
+    };
+}
+
+#endif // CHUNKED_TRANSFER_H
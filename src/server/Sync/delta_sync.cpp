@@ -0,0 +1,477 @@
+#include "delta_sync.h"
+
+#include "rolling_checksum.h"
+#include "storage_path.h"
+#include "xxhash64.h"
+#include "BaseServer/codec.h"
+#include "BaseServer/protocol.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QMultiHash>
+#include <QtMath>
+
+namespace dt = DataTransfer;
+
+constexpr int Sync::DeltaSync::READ_SIZE;
+
+Sync::DeltaSync::DeltaSync(const QString &root):
+    _root(root)
+{}
+
+Sync::DeltaSync::~DeltaSync()
+{}
+
+void Sync::DeltaSync::register_handlers(dt::RequestDispatcher &dispatcher)
+{
+    dispatcher.register_handler(DELTA_SIGNATURE, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString path;
+        qint32 block_size = 0;
+        dt::Codec::Reader reader(request);
+        reader >> path >> block_size;
+        return reader.is_valid() && signature_file(path, block_size, response);
+    }, dt::Compression::Traffic::BULK);
+
+    dispatcher.register_handler(MAKE_DELTA, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString path;
+        QByteArray signature;
+        dt::Codec::Reader reader(request);
+        reader >> path >> signature;
+        return reader.is_valid() && delta_file(path, signature, response);
+    }, dt::Compression::Traffic::BULK);
+
+    dispatcher.register_handler(APPLY_DELTA, [this](const QByteArray &request, QByteArray &)
+    {
+        QString path;
+        qint32 block_size = 0;
+        qint64 size = 0;
+        QByteArray delta;
+        dt::Codec::Reader reader(request);
+        reader >> path >> block_size >> size >> delta;
+        return reader.is_valid() && patch_file(path, block_size, size, delta);
+    });
+}
+
+// Same heuristic as rsync: sqrt(size) keeps signature and literal overhead
+// balanced as files grow.
+qint32 Sync::DeltaSync::block_size_for(qint64 file_size)
+{
+    if(file_size <= static_cast<qint64>(MIN_BLOCK_SIZE) * MIN_BLOCK_SIZE)
+    {
+        return MIN_BLOCK_SIZE;
+    }
+    qint64 size = static_cast<qint64>(qSqrt(static_cast<qreal>(file_size))) & ~static_cast<qint64>(7);
+    return static_cast<qint32>(qBound<qint64>(MIN_BLOCK_SIZE, size, MAX_BLOCK_SIZE));
+}
+
+quint64 Sync::DeltaSync::strong_hash(const char *data, int size)
+{
+    return xxhash64(data, size);
+}
+
+bool Sync::DeltaSync::make_signature(QIODevice &base, qint32 block_size, Signature &signature)
+{
+    if(block_size <= 0 || !base.isReadable())
+    {
+        return false;
+    }
+
+    signature.file_size = base.size();
+    signature.block_size = block_size;
+    signature.blocks.clear();
+    signature.blocks.reserve(static_cast<int>((signature.file_size + block_size - 1) / block_size));
+
+    const qint64 read_size = static_cast<qint64>(block_size) * qMax(1, READ_SIZE / block_size);
+    while(!base.atEnd())
+    {
+        QByteArray data = base.read(read_size);
+        if(data.isEmpty())
+        {
+            return false;
+        }
+        for (int offset = 0; offset < data.size(); offset += block_size)
+        {
+            int length = qMin(block_size, data.size() - offset);
+            const char *block = data.constData() + offset;
+            signature.blocks.push_back({RollingChecksum::compute(block, length), strong_hash(block, length)});
+        }
+    }
+    return true;
+}
+
+bool Sync::DeltaSync::make_delta(const Signature &signature, QIODevice &target, Delta &delta)
+{
+    delta.clear();
+    const qint32 block_size = signature.block_size;
+    if(!target.isReadable() || (block_size <= 0 && !signature.blocks.isEmpty()))
+    {
+        return false;
+    }
+
+    auto push_literal = [&delta](const char *data, int size)
+    {
+        while(size > 0)
+        {
+            if(delta.isEmpty() || delta.last().type != DeltaOp::LITERAL || delta.last().data.size() >= MAX_LITERAL_SIZE)
+            {
+                DeltaOp op;
+                op.type = DeltaOp::LITERAL;
+                delta.push_back(op);
+            }
+            QByteArray &literal = delta.last().data;
+            int length = qMin(size, MAX_LITERAL_SIZE - literal.size());
+            literal.append(data, length);
+            data += length;
+            size -= length;
+        }
+    };
+
+    auto push_copy = [&delta](qint32 block)
+    {
+        if(!delta.isEmpty() && delta.last().type == DeltaOp::COPY
+                && delta.last().block + delta.last().count == block)
+        {
+            delta.last().count++;
+            return;
+        }
+        DeltaOp op;
+        op.type = DeltaOp::COPY;
+        op.block = block;
+        op.count = 1;
+        delta.push_back(op);
+    };
+
+    if(signature.blocks.isEmpty())
+    {
+        while(!target.atEnd())
+        {
+            QByteArray data = target.read(READ_SIZE);
+            if(data.isEmpty())
+            {
+                return false;
+            }
+            push_literal(data.constData(), data.size());
+        }
+        return true;
+    }
+
+    const int count_blocks = signature.blocks.size();
+    const int last_size = static_cast<int>(signature.file_size - static_cast<qint64>(count_blocks - 1) * block_size);
+    QMultiHash<quint32,qint32> index;
+    index.reserve(count_blocks);
+    for (qint32 i = 0; i < count_blocks; i++)
+    {
+        index.insert(signature.blocks[i].weak, i);
+    }
+
+    // Prefers the block right after the previous match so unchanged runs
+    // collapse into a single COPY.
+    auto find_block = [&](quint32 weak, const char *window, int length) -> qint32
+    {
+        qint32 preferred = !delta.isEmpty() && delta.last().type == DeltaOp::COPY
+                ? delta.last().block + delta.last().count : -1;
+        qint32 found = -1;
+        quint64 strong = 0;
+        bool has_strong = false;
+        for (auto it = index.find(weak); it != index.end() && it.key() == weak; ++it)
+        {
+            qint32 block = it.value();
+            if((block == count_blocks - 1 ? last_size : block_size) != length)
+            {
+                continue;
+            }
+            if(!has_strong)
+            {
+                strong = strong_hash(window, length);
+                has_strong = true;
+            }
+            if(signature.blocks[block].strong == strong)
+            {
+                found = block;
+                if(block == preferred)
+                {
+                    break;
+                }
+            }
+        }
+        return found;
+    };
+
+    QByteArray buffer;
+    RollingChecksum checksum;
+    int start = 0;
+    int position = 0;
+    bool is_end = false;
+    bool is_reset = true;
+
+    while(true)
+    {
+        // Keep a full window plus the next byte to roll in.
+        if(!is_end && buffer.size() - position <= block_size)
+        {
+            buffer.remove(0, start);
+            position -= start;
+            start = 0;
+            QByteArray data = target.read(qMax(READ_SIZE, block_size * 4));
+            if(data.isEmpty())
+            {
+                is_end = true;
+            }
+            buffer.append(data);
+            continue;
+        }
+
+        int available = buffer.size() - position;
+        if(available == 0)
+        {
+            break;
+        }
+
+        int length = qMin(block_size, available);
+        const char *window = buffer.constData() + position;
+        if(length == block_size || length == last_size)
+        {
+            if(is_reset)
+            {
+                checksum.reset(window, length);
+                is_reset = false;
+            }
+            qint32 block = find_block(checksum.value(), window, length);
+            if(block >= 0)
+            {
+                push_literal(buffer.constData() + start, position - start);
+                push_copy(block);
+                position += length;
+                start = position;
+                is_reset = true;
+                continue;
+            }
+        }
+
+        if(length == block_size && available > block_size && !is_reset)
+        {
+            checksum.roll(window[0], window[block_size]);
+        }
+        else
+        {
+            is_reset = true;
+        }
+        position++;
+
+        if(position - start >= MAX_LITERAL_SIZE)
+        {
+            push_literal(buffer.constData() + start, position - start);
+            start = position;
+        }
+    }
+
+    push_literal(buffer.constData() + start, position - start);
+    return true;
+}
+
+bool Sync::DeltaSync::apply_delta(QIODevice &base, qint32 block_size, const Delta &delta, QIODevice &out)
+{
+    if(!out.isWritable())
+    {
+        return false;
+    }
+
+    for (auto &op : delta)
+    {
+        if(op.type == DeltaOp::LITERAL)
+        {
+            if(out.write(op.data) != op.data.size())
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if(block_size <= 0 || op.block < 0 || op.count <= 0 || !base.seek(static_cast<qint64>(op.block) * block_size))
+        {
+            return false;
+        }
+        qint64 remaining = static_cast<qint64>(op.count) * block_size;
+        while(remaining > 0)
+        {
+            QByteArray data = base.read(qMin<qint64>(remaining, READ_SIZE));
+            if(data.isEmpty())
+            {
+                // Only the last block of the base may be short.
+                if(base.atEnd() && remaining < block_size)
+                {
+                    break;
+                }
+                return false;
+            }
+            if(out.write(data) != data.size())
+            {
+                return false;
+            }
+            remaining -= data.size();
+        }
+    }
+    return true;
+}
+
+QByteArray Sync::DeltaSync::encode_signature(const Signature &signature)
+{
+    QByteArray data;
+    data.reserve(16 + signature.blocks.size() * 12);
+    dt::Codec::append(data, signature.file_size, signature.block_size, static_cast<qint32>(signature.blocks.size()));
+    for (auto &block : signature.blocks)
+    {
+        dt::Codec::append(data, block.weak, block.strong);
+    }
+    return data;
+}
+
+bool Sync::DeltaSync::decode_signature(const QByteArray &data, Signature &signature)
+{
+    dt::Codec::Reader reader(data);
+    qint32 count = 0;
+    reader >> signature.file_size >> signature.block_size >> count;
+    if(!reader.is_valid() || count < 0 || count > (data.size() - reader.position()) / 12)
+    {
+        return false;
+    }
+
+    signature.blocks.resize(count);
+    for (auto &block : signature.blocks)
+    {
+        reader >> block.weak >> block.strong;
+    }
+    return reader.is_valid() && reader.at_end();
+}
+
+QByteArray Sync::DeltaSync::encode_delta(const Delta &delta)
+{
+    QByteArray data;
+    dt::Codec::append(data, static_cast<qint32>(delta.size()));
+    for (auto &op : delta)
+    {
+        if(op.type == DeltaOp::COPY)
+        {
+            dt::Codec::append(data, static_cast<quint8>(op.type), op.block, op.count);
+        }
+        else
+        {
+            dt::Codec::append(data, static_cast<quint8>(op.type), op.data);
+        }
+    }
+    return data;
+}
+
+bool Sync::DeltaSync::decode_delta(const QByteArray &data, Delta &delta)
+{
+    dt::Codec::Reader reader(data);
+    qint32 count = 0;
+    reader >> count;
+    if(!reader.is_valid() || count < 0 || count > data.size())
+    {
+        return false;
+    }
+
+    delta.clear();
+    delta.reserve(count);
+    for (qint32 i = 0; i < count && reader.is_valid(); i++)
+    {
+        quint8 type = 0;
+        DeltaOp op;
+        reader >> type;
+        if(type == DeltaOp::COPY)
+        {
+            reader >> op.block >> op.count;
+        }
+        else if(type == DeltaOp::LITERAL)
+        {
+            op.type = DeltaOp::LITERAL;
+            reader >> op.data;
+        }
+        else
+        {
+            return false;
+        }
+        delta.push_back(op);
+    }
+    return reader.is_valid() && reader.at_end();
+}
+
+bool Sync::DeltaSync::signature_file(const QString &path, qint32 block_size, QByteArray &response) const
+{
+    QString target;
+    if(!resolve_storage_path(_root, path, target))
+    {
+        return false;
+    }
+
+    // A missing file has an empty signature: the client sends everything as literals.
+    Signature signature;
+    QFile file(target);
+    if(file.open(QIODevice::ReadOnly))
+    {
+        if(!make_signature(file, block_size > 0 ? block_size : block_size_for(file.size()), signature))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        signature.block_size = block_size > 0 ? block_size : MIN_BLOCK_SIZE;
+    }
+    response = encode_signature(signature);
+    return static_cast<quint32>(response.size()) <= dt::Protocol::MAX_PAYLOAD_SIZE;
+}
+
+bool Sync::DeltaSync::delta_file(const QString &path, const QByteArray &data, QByteArray &response) const
+{
+    QString target;
+    Signature signature;
+    if(!resolve_storage_path(_root, path, target) || !decode_signature(data, signature))
+    {
+        return false;
+    }
+
+    QFile file(target);
+    Delta delta;
+    if(!file.open(QIODevice::ReadOnly) || !make_delta(signature, file, delta))
+    {
+        return false;
+    }
+    response = dt::Codec::encode(file.size(), encode_delta(delta));
+    // Deltas that do not fit a frame fall back to a chunked transfer.
+    return static_cast<quint32>(response.size()) <= dt::Protocol::MAX_PAYLOAD_SIZE;
+}
+
+bool Sync::DeltaSync::patch_file(const QString &path, qint32 block_size, qint64 size, const QByteArray &data) const
+{
+    QString target;
+    Delta delta;
+    if(!resolve_storage_path(_root, path, target) || !decode_delta(data, delta))
+    {
+        return false;
+    }
+
+    // QSaveFile writes next to the target and renames over it on commit, so
+    // the old file stays intact until the new one is complete.
+    QFile base(target);
+    QSaveFile out(target);
+    if(base.exists() && !base.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    if(!out.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    // An uncommitted QSaveFile removes its temporary file when destroyed.
+    if(!apply_delta(base, block_size, delta, out) || out.size() != size)
+    {
+        return false;
+    }
+    base.close();
+    return out.commit();
+}
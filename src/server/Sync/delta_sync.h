@@ -0,0 +1,83 @@
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QIODevice>
+
+#include "BaseServer/request_dispatcher.h"
+#include "sync_messages.h"
+
+namespace Sync
+{
+    struct BlockSignature
+    {
+        quint32 weak = 0;
+        quint64 strong = 0;
+    };
+
+    struct Signature
+    {
+        qint64 file_size = 0;
+        qint32 block_size = 0;
+        QVector<BlockSignature> blocks;
+    };
+
+    struct DeltaOp
+    {
+        enum Type : quint8 {COPY = 0, LITERAL = 1};
+
+        Type type = COPY;
+        qint32 block = 0;
+        qint32 count = 0;
+        QByteArray data;
+    };
+
+    using Delta = QVector<DeltaOp>;
+
+    // rsync-style delta: the side holding the old file sends per-block weak
+    // and strong checksums, the side holding the new file answers with COPY
+    // runs of matching blocks and LITERAL bytes for everything else.
+    class DeltaSync
+    {
+    public:
+        static constexpr qint32 MIN_BLOCK_SIZE = 700;
+        static constexpr qint32 MAX_BLOCK_SIZE = 128 * 1024;
+        static constexpr int MAX_LITERAL_SIZE = 64 * 1024;
+
+        explicit DeltaSync(const QString &root);
+        DeltaSync(const DeltaSync&) = delete;
+        DeltaSync(const DeltaSync&&) = delete;
+        DeltaSync& operator=(const DeltaSync&) = delete;
+        DeltaSync& operator=(const DeltaSync&&) = delete;
+        virtual ~DeltaSync();
+
+        void register_handlers(DataTransfer::RequestDispatcher &dispatcher);
+
+        static qint32 block_size_for(qint64 file_size);
+
+        static bool make_signature(QIODevice &base, qint32 block_size, Signature &signature);
+        static bool make_delta(const Signature &signature, QIODevice &target, Delta &delta);
+        static bool apply_delta(QIODevice &base, qint32 block_size, const Delta &delta, QIODevice &out);
+
+        static QByteArray encode_signature(const Signature &signature);
+        static bool decode_signature(const QByteArray &data, Signature &signature);
+        static QByteArray encode_delta(const Delta &delta);
+        static bool decode_delta(const QByteArray &data, Delta &delta);
+
+    private:
+        static constexpr int READ_SIZE = 1024 * 1024;
+
+        static quint64 strong_hash(const char *data, int size);
+
+        bool signature_file(const QString &path, qint32 block_size, QByteArray &response) const;
+        bool delta_file(const QString &path, const QByteArray &signature, QByteArray &response) const;
+        bool patch_file(const QString &path, qint32 block_size, qint64 size, const QByteArray &delta) const;
+
+        QString _root;
+    };
+}
+
+#endif // DELTA_SYNC_H
@@ -0,0 +1,54 @@
+#include "file_listing.h"
+
+#include "BaseServer/codec.h"
+
+namespace dt = DataTransfer;
+namespace db = DataBaseWork;
+
+Sync::FileListing::FileListing(db::WorkerServerDataBase &data_base):
+    _data_base(data_base)
+{}
+
+Sync::FileListing::~FileListing()
+{
+
+}
+
+void Sync::FileListing::register_handlers(dt::RequestDispatcher &dispatcher)
+{
+    dispatcher.register_handler(LIST_FILES, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString user;
+        QString after;
+        quint32 limit = 0;
+        dt::Codec::Reader reader(request);
+        reader >> user >> after >> limit;
+        if(!reader.is_valid())
+        {
+            return false;
+        }
+        return list_files(user, after, limit == 0 ? DEFAULT_PAGE_SIZE : static_cast<int>(qMin<quint32>(limit, MAX_PAGE_SIZE)),
+                          response);
+    });
+}
+
+// Response: row count, then (path, size, created, last modified) per row,
+// then whether the listing is complete. The count is patched in once the
+// page has been read.
+bool Sync::FileListing::list_files(const QString &user, const QString &after, int limit, QByteArray &response)
+{
+    response = dt::Codec::encode(quint32(0));
+    int count = _data_base.read_files_page(user, after, limit,
+                                           [&response](const QString &path, const db::WorkerServerDataBase::FileCharacteristics &data)
+    {
+        dt::Codec::append(response, path, data);
+    });
+    if(count < 0)
+    {
+        return false;
+    }
+
+    dt::Codec::Serializer<quint32>::write(response.data(), static_cast<quint32>(count));
+    dt::Codec::append(response, count < limit);
+    return true;
+}
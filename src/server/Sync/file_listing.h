@@ -0,0 +1,35 @@
+#ifndef FILE_LISTING_H
+#define FILE_LISTING_H
+
+#include "BaseServer/request_dispatcher.h"
+#include "Workers/workerserverdatabase.h"
+#include "sync_messages.h"
+
+namespace Sync
+{
+    // Serves a user's file metadata page by page. A LIST_FILES request names
+    // the last path the client has seen; rows are encoded into the response
+    // as they come off the cursor.
+    class FileListing
+    {
+    public:
+        static constexpr int DEFAULT_PAGE_SIZE = 1024;
+        static constexpr int MAX_PAGE_SIZE = 8192;
+
+        explicit FileListing(DataBaseWork::WorkerServerDataBase &data_base);
+        FileListing(const FileListing&) = delete;
+        FileListing(const FileListing&&) = delete;
+        FileListing& operator=(const FileListing&) = delete;
+        FileListing& operator=(const FileListing&&) = delete;
+        virtual ~FileListing();
+
+        void register_handlers(DataTransfer::RequestDispatcher &dispatcher);
+
+        bool list_files(const QString &user, const QString &after, int limit, QByteArray &response);
+
+    private:
+        DataBaseWork::WorkerServerDataBase &_data_base;
+    };
+}
+
+#endif // FILE_LISTING_H
@@ -0,0 +1,435 @@
+#include "file_watcher.h"
+
+#include "Workers/schema.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace db = DataBaseWork;
+
+namespace
+{
+    constexpr quint32 WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+                                 | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+    constexpr int EVENT_BUFFER_SIZE = 64 * 1024;
+
+    bool read_metadata(const QString &path, db::WorkerServerDataBase::FileCharacteristics &data)
+    {
+        QFileInfo info(path);
+        if(!info.exists() || !info.isFile())
+        {
+            return false;
+        }
+        data = std::make_tuple(static_cast<quint64>(info.size()),
+                               db::Schema::format_date(info.created()),
+                               db::Schema::format_date(info.lastModified()));
+        return true;
+    }
+
+    bool is_under(const QString &path, const QString &dir)
+    {
+        return path.startsWith(dir) && path.size() > dir.size() && path[dir.size()] == '/';
+    }
+}
+
+constexpr int Sync::FileWatcher::DEFAULT_COALESCE_MSEC;
+constexpr int Sync::FileWatcher::RESCAN_SLICE_FILES;
+
+Sync::FileWatcher::FileWatcher(db::WorkerServerDataBase &data_base, int coalesce_msec):
+    _data_base(data_base),
+    _coalesce_msec(coalesce_msec),
+    _descriptor(-1)
+{
+    _timer.setSingleShot(true);
+    _timer.setInterval(_coalesce_msec);
+    connect(&_timer, &QTimer::timeout, this, &FileWatcher::flush);
+    _rescan_timer.setInterval(0);
+    connect(&_rescan_timer, &QTimer::timeout, this, &FileWatcher::rescan_slice);
+}
+
+Sync::FileWatcher::~FileWatcher()
+{
+    stop();
+}
+
+bool Sync::FileWatcher::start()
+{
+    if(_descriptor >= 0)
+    {
+        return true;
+    }
+
+    _descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(_descriptor < 0)
+    {
+        return false;
+    }
+    _notifier.reset(new QSocketNotifier(_descriptor, QSocketNotifier::Read));
+    connect(_notifier.get(), &QSocketNotifier::activated, this, &FileWatcher::read_events);
+    return true;
+}
+
+void Sync::FileWatcher::stop()
+{
+    _timer.stop();
+    _rescan_timer.stop();
+    _notifier.reset();
+    if(_descriptor >= 0)
+    {
+        ::close(_descriptor);
+        _descriptor = -1;
+    }
+    _watches.clear();
+    _paths.clear();
+    _users_dirs.clear();
+    _pending.clear();
+    _rescans.clear();
+    _rescan.reset();
+}
+
+bool Sync::FileWatcher::watch_user(const QString &user)
+{
+    if(_descriptor < 0)
+    {
+        return false;
+    }
+
+    unwatch_user(user);
+    QStringList dirs;
+    for (auto &dir : _data_base.get_data_dir_user(user))
+    {
+        QString path = QDir::cleanPath(QDir::fromNativeSeparators(dir));
+        if(QFileInfo(path).isDir())
+        {
+            dirs.append(path);
+            add_watches(path, user, false);
+        }
+    }
+    _users_dirs.insert(user, dirs);
+    return !dirs.isEmpty();
+}
+
+void Sync::FileWatcher::unwatch_user(const QString &user)
+{
+    if(!_users_dirs.remove(user))
+    {
+        return;
+    }
+    _pending.remove(user);
+    _rescans.removeAll(user);
+    if(_rescan && _rescan->user == user)
+    {
+        _rescan.reset();
+    }
+
+    QList<int> unused;
+    for (auto it = _watches.begin(); it != _watches.end(); it++)
+    {
+        it.value().users.remove(user);
+        if(it.value().users.isEmpty())
+        {
+            unused.append(it.key());
+        }
+    }
+    for (int watch : unused)
+    {
+        inotify_rm_watch(_descriptor, watch);
+        remove_watch(watch);
+    }
+}
+
+// Catch-up after an overflow or a restart: only paths whose stat() differs
+// from the stored row are queued. The walk itself happens in rescan_slice().
+void Sync::FileWatcher::rescan_user(const QString &user)
+{
+    if(!_users_dirs.contains(user) || _rescans.contains(user))
+    {
+        return;
+    }
+    _rescans.enqueue(user);
+    if(!_rescan_timer.isActive())
+    {
+        _rescan_timer.start();
+    }
+}
+
+// Stats at most RESCAN_SLICE_FILES paths, then yields to the event loop.
+void Sync::FileWatcher::rescan_slice()
+{
+    if(!_rescan)
+    {
+        if(_rescans.isEmpty())
+        {
+            _rescan_timer.stop();
+            return;
+        }
+        QString user = _rescans.dequeue();
+        _rescan.reset(new Rescan);
+        _rescan->user = user;
+        _rescan->dirs = _users_dirs.value(user);
+        _rescan->stored = _data_base.get_data_files_user(user);
+    }
+
+    for (int count = 0; count < RESCAN_SLICE_FILES; )
+    {
+        if(!_rescan->files || !_rescan->files->hasNext())
+        {
+            if(_rescan->next_dir >= _rescan->dirs.size())
+            {
+                finish_rescan();
+                return;
+            }
+            _rescan->files.reset(new QDirIterator(_rescan->dirs.at(_rescan->next_dir++),
+                                                  QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot,
+                                                  QDirIterator::Subdirectories));
+            continue;
+        }
+
+        QString path = _rescan->files->next();
+        _rescan->on_disk.insert(path);
+        db::WorkerServerDataBase::FileCharacteristics data;
+        auto found = _rescan->stored.constFind(path);
+        if(found == _rescan->stored.constEnd() || (read_metadata(path, data) && data != found.value()))
+        {
+            mark_path(_rescan->user, path);
+        }
+        count++;
+    }
+}
+
+void Sync::FileWatcher::finish_rescan()
+{
+    const Rescan &rescan = *_rescan;
+    for (auto it = rescan.stored.constBegin(); it != rescan.stored.constEnd(); it++)
+    {
+        if(rescan.on_disk.contains(it.key()))
+        {
+            continue;
+        }
+        for (auto &dir : rescan.dirs)
+        {
+            if(is_under(it.key(), dir))
+            {
+                mark_path(rescan.user, it.key());
+                break;
+            }
+        }
+    }
+    _rescan.reset();
+}
+
+int Sync::FileWatcher::count_watches()const
+{
+    return _watches.size();
+}
+
+void Sync::FileWatcher::read_events()
+{
+    alignas(inotify_event) char buffer[EVENT_BUFFER_SIZE];
+    while(true)
+    {
+        ssize_t size = ::read(_descriptor, buffer, sizeof(buffer));
+        if(size <= 0)
+        {
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < size; )
+        {
+            auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            QString name = event->len > 0 ? QString::fromLocal8Bit(event->name) : QString();
+            handle_event(event->wd, event->mask, name);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        }
+    }
+}
+
+void Sync::FileWatcher::handle_event(int watch, quint32 mask, const QString &name)
+{
+    if(mask & IN_Q_OVERFLOW)
+    {
+        for (auto &user : _users_dirs.keys())
+        {
+            rescan_user(user);
+        }
+        return;
+    }
+
+    auto found = _watches.constFind(watch);
+    if(found == _watches.constEnd())
+    {
+        return;
+    }
+    if(mask & IN_IGNORED)
+    {
+        remove_watch(watch);
+        return;
+    }
+    if(name.isEmpty())
+    {
+        return;
+    }
+
+    QString path = found.value().path + '/' + name;
+    auto users = found.value().users;
+    if(mask & IN_ISDIR)
+    {
+        if(mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            for (auto &user : users)
+            {
+                _pending[user].removed_dirs.insert(path);
+            }
+            QList<int> stale;
+            for (auto it = _watches.constBegin(); it != _watches.constEnd(); it++)
+            {
+                if(it.value().path == path || is_under(it.value().path, path))
+                {
+                    stale.append(it.key());
+                }
+            }
+            for (int stale_watch : stale)
+            {
+                inotify_rm_watch(_descriptor, stale_watch);
+                remove_watch(stale_watch);
+            }
+        }
+        if(mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            for (auto &user : users)
+            {
+                add_watches(path, user, true);
+            }
+        }
+    }
+    else
+    {
+        for (auto &user : users)
+        {
+            mark_path(user, path);
+        }
+    }
+
+    if(!_pending.isEmpty() && !_timer.isActive())
+    {
+        _timer.start();
+    }
+}
+
+// A dir that appears while watched may already hold files created before its
+// watch existed, so is_new also queues everything found inside.
+void Sync::FileWatcher::add_watches(const QString &dir, const QString &user, bool is_new)
+{
+    QStringList dirs(dir);
+    QDirIterator it(dir, QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+        dirs.append(it.next());
+    }
+
+    for (auto &path : dirs)
+    {
+        int watch = inotify_add_watch(_descriptor, QFile::encodeName(path).constData(), WATCH_MASK);
+        if(watch < 0)
+        {
+            continue;
+        }
+        auto &entry = _watches[watch];
+        entry.path = path;
+        entry.users.insert(user);
+        _paths.insert(path, watch);
+    }
+
+    if(is_new)
+    {
+        QDirIterator files(dir, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while(files.hasNext())
+        {
+            mark_path(user, files.next());
+        }
+    }
+}
+
+void Sync::FileWatcher::remove_watch(int watch)
+{
+    auto found = _watches.find(watch);
+    if(found == _watches.end())
+    {
+        return;
+    }
+    if(_paths.value(found.value().path, -1) == watch)
+    {
+        _paths.remove(found.value().path);
+    }
+    _watches.erase(found);
+}
+
+void Sync::FileWatcher::mark_path(const QString &user, const QString &path)
+{
+    _pending[user].paths.insert(path);
+    if(!_timer.isActive())
+    {
+        _timer.start();
+    }
+}
+
+void Sync::FileWatcher::flush()
+{
+    auto pending = _pending;
+    _pending.clear();
+
+    for (auto it = pending.begin(); it != pending.end(); it++)
+    {
+        const QString &user = it.key();
+        QSet<QString> &paths = it.value().paths;
+
+        db::WorkerServerDataBase::FileMetaData changed;
+        QStringList gone;
+        for (auto &path : paths)
+        {
+            db::WorkerServerDataBase::FileCharacteristics data;
+            if(read_metadata(path, data))
+            {
+                changed.insert(path, data);
+            }
+            else
+            {
+                gone.append(path);
+            }
+        }
+
+        // The database drops only rows that exist and reports which ones, so
+        // files that came and went within one window are not announced. A
+        // dir's rows go with one range delete; paths recreated since are
+        // upserted again in the same transaction.
+        QStringList removed_dirs = it.value().removed_dirs.values();
+        if(changed.isEmpty() && gone.isEmpty() && removed_dirs.isEmpty())
+        {
+            continue;
+        }
+        QStringList removed;
+        if(!_data_base.apply_file_changes(user, db::WorkerServerDataBase::FileMetaData(), changed,
+                                          gone, removed_dirs, removed))
+        {
+            continue;
+        }
+        for (int i = removed.size() - 1; i >= 0; i--)
+        {
+            if(changed.contains(removed[i]))
+            {
+                removed.removeAt(i);
+            }
+        }
+        if(!changed.isEmpty() || !removed.isEmpty())
+        {
+            emit files_changed(user, changed.keys(), removed);
+        }
+    }
+}
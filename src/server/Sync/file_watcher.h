@@ -0,0 +1,100 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QQueue>
+#include <QTimer>
+#include <QDirIterator>
+#include <QSocketNotifier>
+
+#include <memory>
+
+#include "Workers/workerserverdatabase.h"
+
+namespace Sync
+{
+    // Watches every registered dir of a user through inotify and keeps the
+    // files table in step with the disk. Events are coalesced per user for
+    // coalesce_msec, then only the touched paths are stat()ed and written in
+    // one transaction. A queue overflow falls back to a rescan of the
+    // watched users. Rescans run a slice at a time from a zero-delay timer,
+    // so the event loop keeps serving connections meanwhile.
+    class FileWatcher : public QObject
+    {
+        Q_OBJECT
+
+    signals:
+        void files_changed(const QString &user, const QStringList &changed, const QStringList &removed);
+
+    public:
+        static constexpr int DEFAULT_COALESCE_MSEC = 200;
+        static constexpr int RESCAN_SLICE_FILES = 256;
+
+        explicit FileWatcher(DataBaseWork::WorkerServerDataBase &data_base, int coalesce_msec = DEFAULT_COALESCE_MSEC);
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher(const FileWatcher&&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&&) = delete;
+        virtual ~FileWatcher();
+
+        bool start();
+        void stop();
+
+        bool watch_user(const QString &user);
+        void unwatch_user(const QString &user);
+        void rescan_user(const QString &user);
+
+        int count_watches()const;
+
+    private:
+        struct Watch
+        {
+            QString path;
+            QSet<QString> users;
+        };
+
+        struct Pending
+        {
+            QSet<QString> paths;
+            QSet<QString> removed_dirs;
+        };
+
+        struct Rescan
+        {
+            QString user;
+            QStringList dirs;
+            int next_dir = 0;
+            std::unique_ptr<QDirIterator> files;
+            DataBaseWork::WorkerServerDataBase::FileMetaData stored;
+            QSet<QString> on_disk;
+        };
+
+        void read_events();
+        void handle_event(int watch, quint32 mask, const QString &name);
+        void add_watches(const QString &dir, const QString &user, bool is_new);
+        void remove_watch(int watch);
+        void mark_path(const QString &user, const QString &path);
+        void rescan_slice();
+        void finish_rescan();
+        void flush();
+
+        DataBaseWork::WorkerServerDataBase &_data_base;
+        int _coalesce_msec;
+        int _descriptor;
+        std::unique_ptr<QSocketNotifier> _notifier;
+        QTimer _timer;
+        QHash<int,Watch> _watches;
+        QHash<QString,int> _paths;
+        QHash<QString,QStringList> _users_dirs;
+        QHash<QString,Pending> _pending;
+        QQueue<QString> _rescans;
+        std::unique_ptr<Rescan> _rescan;
+        QTimer _rescan_timer;
+    };
+}
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,304 @@
+#include "merkle_tree.h"
+
+#include "xxhash64.h"
+#include "BaseServer/codec.h"
+
+#include <QDir>
+
+namespace dt = DataTransfer;
+namespace db = DataBaseWork;
+
+Sync::MerkleTree::MerkleTree():
+    _count_files(0)
+{}
+
+QStringList Sync::MerkleTree::split_path(const QString &path)
+{
+    return QDir::cleanPath(QDir::fromNativeSeparators(path)).split('/', QString::SkipEmptyParts);
+}
+
+quint64 Sync::MerkleTree::leaf_hash(const FileCharacteristics &data)
+{
+    return xxhash64(dt::Codec::encode(data));
+}
+
+void Sync::MerkleTree::update_file(const QString &path, const FileCharacteristics &data)
+{
+    QStringList parts = split_path(path);
+    if(parts.isEmpty())
+    {
+        return;
+    }
+
+    Node *node = &_root;
+    for (int i = 0; i < parts.size(); i++)
+    {
+        node->is_dirty = true;
+        auto &child = node->children[parts[i]];
+        if(!child)
+        {
+            child = QSharedPointer<Node>::create();
+            if(i + 1 == parts.size())
+            {
+                child->is_dir = false;
+                _count_files++;
+            }
+        }
+        else if(i + 1 == parts.size() && child->is_dir)
+        {
+            // A directory replaced by a file with the same name.
+            _count_files -= count_leaves(*child) - 1;
+            child = QSharedPointer<Node>::create();
+            child->is_dir = false;
+        }
+        else if(i + 1 < parts.size() && !child->is_dir)
+        {
+            child = QSharedPointer<Node>::create();
+            _count_files--;
+        }
+        node = child.data();
+    }
+    node->hash = leaf_hash(data);
+    node->is_dirty = false;
+}
+
+bool Sync::MerkleTree::remove_file(const QString &path)
+{
+    QStringList parts = split_path(path);
+    if(parts.isEmpty())
+    {
+        return false;
+    }
+
+    QVector<Node*> nodes;
+    Node *node = &_root;
+    for (auto &part : parts)
+    {
+        nodes.push_back(node);
+        auto child = node->children.value(part);
+        if(!child)
+        {
+            return false;
+        }
+        node = child.data();
+    }
+    if(node->is_dir)
+    {
+        return false;
+    }
+
+    // Drop the leaf and every directory it leaves empty.
+    for (int i = nodes.size() - 1; i >= 0; i--)
+    {
+        nodes[i]->is_dirty = true;
+        auto it = nodes[i]->children.find(parts[i]);
+        if(it != nodes[i]->children.end() && (!it.value()->is_dir || it.value()->children.isEmpty()))
+        {
+            nodes[i]->children.erase(it);
+        }
+    }
+    _count_files--;
+    return true;
+}
+
+void Sync::MerkleTree::clear()
+{
+    _root.children.clear();
+    _root.is_dirty = true;
+    _count_files = 0;
+}
+
+quint64 Sync::MerkleTree::root_hash()
+{
+    return update_hash(_root);
+}
+
+quint64 Sync::MerkleTree::hash(const QString &path)
+{
+    Node *node = find_node(split_path(path));
+    return node ? update_hash(*node) : 0;
+}
+
+bool Sync::MerkleTree::children(const QString &dir, QVector<Entry> &entries)
+{
+    Node *node = find_node(split_path(dir));
+    if(!node || !node->is_dir)
+    {
+        return false;
+    }
+
+    entries.clear();
+    entries.reserve(node->children.size());
+    for (auto it = node->children.begin(); it != node->children.end(); it++)
+    {
+        Entry entry;
+        entry.name = it.key();
+        entry.hash = update_hash(*it.value());
+        entry.is_dir = it.value()->is_dir;
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+qint64 Sync::MerkleTree::count_files()const
+{
+    return _count_files;
+}
+
+qint64 Sync::MerkleTree::count_leaves(const Node &node)
+{
+    if(!node.is_dir)
+    {
+        return 1;
+    }
+    qint64 count = 0;
+    for (auto &child : node.children)
+    {
+        count += count_leaves(*child);
+    }
+    return count;
+}
+
+Sync::MerkleTree::Node *Sync::MerkleTree::find_node(const QStringList &parts)
+{
+    Node *node = &_root;
+    for (auto &part : parts)
+    {
+        auto child = node->children.value(part);
+        if(!child)
+        {
+            return nullptr;
+        }
+        node = child.data();
+    }
+    return node;
+}
+
+quint64 Sync::MerkleTree::update_hash(Node &node)
+{
+    if(!node.is_dirty)
+    {
+        return node.hash;
+    }
+
+    QByteArray data;
+    for (auto it = node.children.begin(); it != node.children.end(); it++)
+    {
+        dt::Codec::append(data, it.key(), update_hash(*it.value()), it.value()->is_dir);
+    }
+    node.hash = xxhash64(data);
+    node.is_dirty = false;
+    return node.hash;
+}
+
+Sync::MerkleIndex::MerkleIndex()
+{}
+
+Sync::MerkleIndex::~MerkleIndex()
+{}
+
+void Sync::MerkleIndex::load(db::WorkerServerDataBase &data_base)
+{
+    for (auto &user : data_base.get_all_user())
+    {
+        auto tree = QSharedPointer<MerkleTree>::create();
+        auto visit = [&tree](const QString &path, const MerkleTree::FileCharacteristics &data)
+        {
+            tree->update_file(path, data);
+        };
+        db::FileCursor cursor(data_base, user);
+        while(!cursor.is_done())
+        {
+            if(!cursor.next_page(visit))
+            {
+                break;
+            }
+        }
+
+        QMutexLocker lock(&_mutex);
+        _trees.insert(user, tree);
+    }
+}
+
+void Sync::MerkleIndex::register_handlers(dt::RequestDispatcher &dispatcher)
+{
+    dispatcher.register_handler(MERKLE_ROOT, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString user;
+        dt::Codec::Reader reader(request);
+        reader >> user;
+        if(!reader.is_valid())
+        {
+            return false;
+        }
+        response = dt::Codec::encode(root_hash(user));
+        return true;
+    });
+
+    dispatcher.register_handler(MERKLE_CHILDREN, [this](const QByteArray &request, QByteArray &response)
+    {
+        QString user;
+        QString dir;
+        dt::Codec::Reader reader(request);
+        reader >> user >> dir;
+        QVector<MerkleTree::Entry> entries;
+        if(!reader.is_valid() || !children(user, dir, entries))
+        {
+            return false;
+        }
+        response = dt::Codec::encode(static_cast<qint32>(entries.size()));
+        for (auto &entry : entries)
+        {
+            dt::Codec::append(response, entry.name, entry.hash, entry.is_dir);
+        }
+        return true;
+    });
+}
+
+quint64 Sync::MerkleIndex::root_hash(const QString &user)
+{
+    QMutexLocker lock(&_mutex);
+    auto tree = _trees.value(user);
+    return tree ? tree->root_hash() : 0;
+}
+
+bool Sync::MerkleIndex::children(const QString &user, const QString &dir, QVector<MerkleTree::Entry> &entries)
+{
+    QMutexLocker lock(&_mutex);
+    auto tree = _trees.value(user);
+    return tree ? tree->children(dir, entries) : false;
+}
+
+void Sync::MerkleIndex::files_changed(const QString &user, const db::WorkerServerDataBase::FileMetaData &data)
+{
+    QMutexLocker lock(&_mutex);
+    auto &tree = _trees[user];
+    if(!tree)
+    {
+        tree = QSharedPointer<MerkleTree>::create();
+    }
+    for (auto it = data.begin(); it != data.end(); it++)
+    {
+        tree->update_file(it.key(), it.value());
+    }
+}
+
+void Sync::MerkleIndex::files_removed(const QString &user)
+{
+    QMutexLocker lock(&_mutex);
+    _trees.remove(user);
+}
+
+void Sync::MerkleIndex::file_paths_removed(const QString &user, const QStringList &paths)
+{
+    QMutexLocker lock(&_mutex);
+    auto tree = _trees.value(user);
+    if(!tree)
+    {
+        return;
+    }
+    for (auto &path : paths)
+    {
+        tree->remove_file(path);
+    }
+}
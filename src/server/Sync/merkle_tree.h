@@ -0,0 +1,93 @@
+#ifndef MERKLE_TREE_H
+#define MERKLE_TREE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include "BaseServer/request_dispatcher.h"
+#include "Workers/workerserverdatabase.h"
+#include "sync_messages.h"
+
+namespace Sync
+{
+    // Hash tree mirroring a user's directory layout. A file leaf hashes its
+    // size and dates, a directory hashes its sorted (name, hash) children.
+    // Updates only mark the path to the root dirty; hashes are recomputed on
+    // the next query, touching just the changed branches.
+    class MerkleTree
+    {
+    public:
+        using FileCharacteristics = DataBaseWork::WorkerServerDataBase::FileCharacteristics;
+
+        struct Entry
+        {
+            QString name;
+            quint64 hash = 0;
+            bool is_dir = false;
+        };
+
+        MerkleTree();
+
+        void update_file(const QString &path, const FileCharacteristics &data);
+        bool remove_file(const QString &path);
+        void clear();
+
+        quint64 root_hash();
+        quint64 hash(const QString &path);
+        bool children(const QString &dir, QVector<Entry> &entries);
+        qint64 count_files()const;
+
+    private:
+        struct Node
+        {
+            quint64 hash = 0;
+            bool is_dir = true;
+            bool is_dirty = true;
+            QMap<QString,QSharedPointer<Node>> children;
+        };
+
+        static QStringList split_path(const QString &path);
+        static quint64 leaf_hash(const FileCharacteristics &data);
+        static qint64 count_leaves(const Node &node);
+        Node *find_node(const QStringList &parts);
+        quint64 update_hash(Node &node);
+
+        Node _root;
+        qint64 _count_files;
+    };
+
+    // Keeps one MerkleTree per user in step with the files table through
+    // WorkerServerDataBase's observer hook.
+    class MerkleIndex : public DataBaseWork::WorkerServerDataBase::FileObserver
+    {
+    public:
+        MerkleIndex();
+        MerkleIndex(const MerkleIndex&) = delete;
+        MerkleIndex(const MerkleIndex&&) = delete;
+        MerkleIndex& operator=(const MerkleIndex&) = delete;
+        MerkleIndex& operator=(const MerkleIndex&&) = delete;
+        virtual ~MerkleIndex();
+
+        // Builds every user's tree; call before serving requests.
+        void load(DataBaseWork::WorkerServerDataBase &data_base);
+        void register_handlers(DataTransfer::RequestDispatcher &dispatcher);
+
+        quint64 root_hash(const QString &user);
+        bool children(const QString &user, const QString &dir, QVector<MerkleTree::Entry> &entries);
+
+        void files_changed(const QString &user, const DataBaseWork::WorkerServerDataBase::FileMetaData &data) override;
+        void files_removed(const QString &user) override;
+        void file_paths_removed(const QString &user, const QStringList &paths) override;
+
+    private:
+        QMutex _mutex;
+        QHash<QString,QSharedPointer<MerkleTree>> _trees;
+    };
+}
+
+#endif // MERKLE_TREE_H
@@ -0,0 +1,85 @@
+#include "rolling_checksum.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SSE2_CHECKSUM
+#endif
+
+Sync::RollingChecksum::RollingChecksum():
+    _a(0),
+    _b(0),
+    _size(0)
+{}
+
+// Over a block of n bytes, b = sum((n - i) * x[i]). The SSE2 path handles 16
+// bytes per step: b grows by 16 * a (the running sum before the step) plus the
+// step's bytes weighted 16..1. Everything wraps mod 2^32, which keeps the low
+// 16 bits exact.
+void Sync::RollingChecksum::sum(const char *data, int size, quint32 &a, quint32 &b)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    int i = 0;
+    a = 0;
+    b = 0;
+
+#ifdef HAVE_SSE2_CHECKSUM
+    if(size >= 16)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights_high = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+        const __m128i weights_low = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+        __m128i sum_a = zero;
+        __m128i sum_prefix = zero;
+        __m128i sum_weighted = zero;
+
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            sum_prefix = _mm_add_epi64(sum_prefix, sum_a);
+            sum_a = _mm_add_epi64(sum_a, _mm_sad_epu8(block, zero));
+            sum_weighted = _mm_add_epi32(sum_weighted, _mm_madd_epi16(_mm_unpacklo_epi8(block, zero), weights_high));
+            sum_weighted = _mm_add_epi32(sum_weighted, _mm_madd_epi16(_mm_unpackhi_epi8(block, zero), weights_low));
+        }
+
+        quint32 lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_a);
+        a = lanes[0] + lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_prefix);
+        quint32 prefix = lanes[0] + lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_weighted);
+        b = 16 * prefix + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        a += bytes[i];
+        b += a;
+    }
+}
+
+quint32 Sync::RollingChecksum::compute(const char *data, int size)
+{
+    quint32 a;
+    quint32 b;
+    sum(data, size, a, b);
+    return (a & 0xFFFF) | (b << 16);
+}
+
+void Sync::RollingChecksum::reset(const char *data, int size)
+{
+    sum(data, size, _a, _b);
+    _size = static_cast<quint32>(size);
+}
+
+void Sync::RollingChecksum::roll(char out, char in)
+{
+    quint32 removed = static_cast<unsigned char>(out);
+    _a += static_cast<unsigned char>(in) - removed;
+    _b += _a - _size * removed;
+}
+
+quint32 Sync::RollingChecksum::value()const
+{
+    return (_a & 0xFFFF) | (_b << 16);
+}
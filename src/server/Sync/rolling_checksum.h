@@ -0,0 +1,30 @@
+#ifndef ROLLING_CHECKSUM_H
+#define ROLLING_CHECKSUM_H
+
+#include <QtGlobal>
+
+namespace Sync
+{
+    // rsync's weak checksum: a = sum of bytes, b = sum of prefix sums, both
+    // mod 2^16. Sliding the window by one byte is O(1).
+    class RollingChecksum
+    {
+    public:
+        RollingChecksum();
+
+        static quint32 compute(const char *data, int size);
+
+        void reset(const char *data, int size);
+        void roll(char out, char in);
+        quint32 value()const;
+
+    private:
+        static void sum(const char *data, int size, quint32 &a, quint32 &b);
+
+        quint32 _a;
+        quint32 _b;
+        quint32 _size;
+    };
+}
+
+#endif // ROLLING_CHECKSUM_H
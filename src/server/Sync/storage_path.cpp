@@ -0,0 +1,15 @@
+#include "storage_path.h"
+
+#include <QDir>
+
+bool Sync::resolve_storage_path(const QString &root, const QString &path, QString &target)
+{
+    QString clean = QDir::cleanPath(path);
+    if(clean.isEmpty() || clean == "." || clean == ".." || clean.startsWith("../")
+            || QDir::isAbsolutePath(clean) || clean.endsWith(PART_SUFFIX) || clean.endsWith(STATE_SUFFIX))
+    {
+        return false;
+    }
+    target = QDir::cleanPath(root) + "/" + clean;
+    return true;
+}
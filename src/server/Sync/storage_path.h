@@ -0,0 +1,19 @@
+#ifndef STORAGE_PATH_H
+#define STORAGE_PATH_H
+
+#include <QString>
+
+namespace Sync
+{
+    // Data and state of an unfinished upload live beside the target under
+    // these suffixes.
+    constexpr const char *PART_SUFFIX = ".part";
+    constexpr const char *STATE_SUFFIX = ".part.state";
+
+    // Maps a client supplied relative path onto the storage root, rejecting
+    // absolute paths, anything that escapes the root through ".." and the
+    // files of unfinished uploads.
+    bool resolve_storage_path(const QString &root, const QString &path, QString &target);
+}
+
+#endif // STORAGE_PATH_H
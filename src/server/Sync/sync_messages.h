@@ -0,0 +1,38 @@
+#ifndef SYNC_MESSAGES_H
+#define SYNC_MESSAGES_H
+
+#include <QtGlobal>
+
+namespace Sync
+{
+    // Frame types used with DataTransfer::RequestDispatcher. Each feature owns
+    // a block of 0x100 values.
+    enum MessageType : quint16
+    {
+        BEGIN_UPLOAD = 0x0100,
+        UPLOAD_CHUNK,
+        UPLOAD_STATUS,
+        FINISH_UPLOAD,
+        READ_CHUNK,
+
+        DELTA_SIGNATURE = 0x0200,
+        MAKE_DELTA,
+        APPLY_DELTA,
+
+        QUERY_CHUNKS = 0x0300,
+        PUT_CHUNK,
+        GET_CHUNK,
+        COMMIT_MANIFEST,
+        GET_MANIFEST,
+        REMOVE_MANIFEST,
+
+        MERKLE_ROOT = 0x0400,
+        MERKLE_CHILDREN,
+
+        FILES_CHANGED = 0x0500,
+        LIST_FILES,
+        SUBSCRIBE_FILES
+    };
+}
+
+#endif // SYNC_MESSAGES_H
@@ -0,0 +1,109 @@
+#include "xxhash64.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+namespace
+{
+    constexpr quint64 PRIME_1 = 0x9E3779B185EBCA87ULL;
+    constexpr quint64 PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr quint64 PRIME_3 = 0x165667B19E3779F9ULL;
+    constexpr quint64 PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr quint64 PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+    inline quint64 rotate_left(quint64 value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline quint64 read_64(const char *data)
+    {
+        quint64 value;
+        memcpy(&value, data, sizeof(value));
+        return qFromLittleEndian(value);
+    }
+
+    inline quint32 read_32(const char *data)
+    {
+        quint32 value;
+        memcpy(&value, data, sizeof(value));
+        return qFromLittleEndian(value);
+    }
+
+    inline quint64 mix_round(quint64 accumulator, quint64 input)
+    {
+        accumulator += input * PRIME_2;
+        accumulator = rotate_left(accumulator, 31);
+        return accumulator * PRIME_1;
+    }
+
+    inline quint64 merge_round(quint64 accumulator, quint64 value)
+    {
+        accumulator ^= mix_round(0, value);
+        return accumulator * PRIME_1 + PRIME_4;
+    }
+}
+
+quint64 Sync::xxhash64(const char *data, qint64 size, quint64 seed)
+{
+    const char *current = data;
+    const char *end = data + size;
+    quint64 hash;
+
+    if(size >= 32)
+    {
+        const char *limit = end - 32;
+        quint64 v1 = seed + PRIME_1 + PRIME_2;
+        quint64 v2 = seed + PRIME_2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - PRIME_1;
+        do
+        {
+            v1 = mix_round(v1, read_64(current));
+            v2 = mix_round(v2, read_64(current + 8));
+            v3 = mix_round(v3, read_64(current + 16));
+            v4 = mix_round(v4, read_64(current + 24));
+            current += 32;
+        }
+        while(current <= limit);
+
+        hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME_5;
+    }
+
+    hash += static_cast<quint64>(size);
+
+    while(end - current >= 8)
+    {
+        hash ^= mix_round(0, read_64(current));
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_4;
+        current += 8;
+    }
+    if(end - current >= 4)
+    {
+        hash ^= static_cast<quint64>(read_32(current)) * PRIME_1;
+        hash = rotate_left(hash, 23) * PRIME_2 + PRIME_3;
+        current += 4;
+    }
+    while(current < end)
+    {
+        hash ^= static_cast<quint64>(static_cast<unsigned char>(*current)) * PRIME_5;
+        hash = rotate_left(hash, 11) * PRIME_1;
+        current++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
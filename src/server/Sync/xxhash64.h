@@ -0,0 +1,19 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+namespace Sync
+{
+    // XXH64 (https://github.com/Cyan4973/xxHash), bit-compatible with the
+    // reference implementation so clients can use the stock library.
+    quint64 xxhash64(const char *data, qint64 size, quint64 seed = 0);
+
+    inline quint64 xxhash64(const QByteArray &data, quint64 seed = 0)
+    {
+        return xxhash64(data.constData(), data.size(), seed);
+    }
+}
+
+#endif // XXHASH64_H
@@ -0,0 +1,181 @@
+#include "Workers/connectionpool.h"
+#include "Workers/workerserverdatabase.h"
+
+using namespace DataBaseWork;
+
+ConnectionPool::ConnectionPool(const QString &type, const QString &data_base_name, const QString &prefix):
+    _type(type),
+    _data_base_name(data_base_name),
+    _prefix(prefix)
+{}
+
+// Worker threads drop their statements when they exit; only the calling
+// thread's are still alive here.
+ConnectionPool::~ConnectionPool()
+{
+    _locals.setLocalData(nullptr);
+
+    QMutexLocker lock(&_mutex);
+    for (auto &name : _names)
+    {
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+// Recursive so that a batch can hold the lane across the writes it groups.
+QMutex &ConnectionPool::writer_lane()
+{
+    static QMutex lane(QMutex::Recursive);
+    return lane;
+}
+
+int ConnectionPool::count_connections()const
+{
+    QMutexLocker lock(&_mutex);
+    return _names.size();
+}
+
+QSqlDatabase ConnectionPool::local()const
+{
+    return local_data().base;
+}
+
+QSqlQuery &ConnectionPool::statement(const char *sql)const
+{
+    Local &data = local_data();
+    auto &query = data.statements[sql];
+    if(!query)
+    {
+        auto prepared = QSharedPointer<QSqlQuery>::create(data.base);
+        prepared->setForwardOnly(true);
+        if(!prepared->prepare(sql))
+        {
+            data.statements.remove(sql);
+            data.unprepared = QSqlQuery(data.base);
+            data.unprepared.prepare(sql);
+            return data.unprepared;
+        }
+        query = prepared;
+    }
+    return *query;
+}
+
+bool ConnectionPool::transaction()const
+{
+    Local &data = local_data();
+    bool is_started = data.depth == 0 ? data.base.transaction()
+                                      : QSqlQuery(data.base).exec(QString("SAVEPOINT level_%1;").arg(data.depth));
+    if(is_started)
+    {
+        data.depth++;
+    }
+    return is_started;
+}
+
+bool ConnectionPool::commit()const
+{
+    Local &data = local_data();
+    if(data.depth == 0)
+    {
+        return false;
+    }
+
+    data.depth--;
+    if(data.depth > 0)
+    {
+        return QSqlQuery(data.base).exec(QString("RELEASE level_%1;").arg(data.depth));
+    }
+    if(!data.base.commit())
+    {
+        data.base.rollback();
+        return false;
+    }
+    return true;
+}
+
+void ConnectionPool::rollback()const
+{
+    Local &data = local_data();
+    if(data.depth == 0)
+    {
+        return;
+    }
+
+    data.depth--;
+    if(data.depth > 0)
+    {
+        QSqlQuery query(data.base);
+        query.exec(QString("ROLLBACK TO level_%1;").arg(data.depth));
+        query.exec(QString("RELEASE level_%1;").arg(data.depth));
+    }
+    else
+    {
+        data.base.rollback();
+    }
+}
+
+int ConnectionPool::depth()const
+{
+    return local_data().depth;
+}
+
+ConnectionPool::Local &ConnectionPool::local_data()const
+{
+    if(_locals.hasLocalData() && _locals.localData()->base.isOpen())
+    {
+        return *_locals.localData();
+    }
+
+    QString name = WorkerServerDataBase::get_new_name_connection(_prefix);
+    bool is_stale = false;
+    if(QSqlDatabase::contains(name))
+    {
+        QSqlDatabase base = QSqlDatabase::database(name, false);
+        if(base.isValid())
+        {
+            if(!base.isOpen() && base.open())
+            {
+                configure(base);
+            }
+            return store(base);
+        }
+        // Left behind by an exited thread that had the same id.
+        is_stale = true;
+    }
+    if(is_stale)
+    {
+        QSqlDatabase::removeDatabase(name);
+    }
+
+    QSqlDatabase base = QSqlDatabase::addDatabase(_type, name);
+    base.setDatabaseName(_data_base_name);
+    if(base.open())
+    {
+        configure(base);
+    }
+
+    QMutexLocker lock(&_mutex);
+    if(!_names.contains(name))
+    {
+        _names.append(name);
+    }
+    lock.unlock();
+    return store(base);
+}
+
+ConnectionPool::Local &ConnectionPool::store(const QSqlDatabase &base)const
+{
+    Local *data = new Local;
+    data->base = base;
+    _locals.setLocalData(data);
+    return *data;
+}
+
+bool ConnectionPool::configure(QSqlDatabase &base)
+{
+    QSqlQuery query(base);
+    return query.exec("PRAGMA journal_mode = WAL;")
+            && query.exec("PRAGMA synchronous = NORMAL;")
+            && query.exec("PRAGMA foreign_keys = ON;")
+            && query.exec(QString("PRAGMA busy_timeout = %1;").arg(BUSY_TIMEOUT_MSEC));
+}
@@ -0,0 +1,67 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QSharedPointer>
+
+namespace DataBaseWork
+{
+    // QSqlDatabase connections may only be used by the thread that opened
+    // them, so the pool hands every thread its own connection, named after
+    // the thread. SQLite runs in WAL mode: readers never block each other or
+    // the writer, and writers line up on one process-wide lane instead of
+    // spinning on SQLITE_BUSY. Statements are prepared once per connection
+    // and reused; the static SQL strings double as cache keys. Transactions
+    // nest: the outermost level is a real BEGIN/COMMIT and inner levels are
+    // savepoints, so a failed inner level only undoes its own changes.
+    class ConnectionPool
+    {
+    public:
+        static constexpr int BUSY_TIMEOUT_MSEC = 5000;
+
+        ConnectionPool(const QString &type, const QString &data_base_name, const QString &prefix);
+        ConnectionPool(const ConnectionPool&) = delete;
+        ConnectionPool(const ConnectionPool&&) = delete;
+        ConnectionPool& operator=(const ConnectionPool&) = delete;
+        ConnectionPool& operator=(const ConnectionPool&&) = delete;
+        virtual ~ConnectionPool();
+
+        QSqlDatabase local()const;
+        QSqlQuery &statement(const char *sql)const;
+
+        bool transaction()const;
+        bool commit()const;
+        void rollback()const;
+        int depth()const;
+        int count_connections()const;
+
+        static QMutex &writer_lane();
+
+    private:
+        struct Local
+        {
+            QSqlDatabase base;
+            QHash<const char*,QSharedPointer<QSqlQuery>> statements;
+            QSqlQuery unprepared;
+            int depth = 0;
+        };
+
+        static bool configure(QSqlDatabase &base);
+        Local &local_data()const;
+        Local &store(const QSqlDatabase &base)const;
+
+        QString _type;
+        QString _data_base_name;
+        QString _prefix;
+        mutable QMutex _mutex;
+        mutable QStringList _names;
+        mutable QThreadStorage<Local*> _locals;
+    };
+}
+
+#endif // CONNECTIONPOOL_H
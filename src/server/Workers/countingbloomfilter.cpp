@@ -0,0 +1,125 @@
+#include "Workers/countingbloomfilter.h"
+
+#include "Sync/xxhash64.h"
+
+#include <cmath>
+
+using namespace DataBaseWork;
+
+namespace
+{
+    constexpr quint64 SECOND_SEED = 0x9E3779B97F4A7C15ULL;
+}
+
+constexpr qint64 CountingBloomFilter::MIN_SIZE;
+
+CountingBloomFilter::CountingBloomFilter(qint64 expected_items, double false_positive_rate, qint64 max_bytes):
+    _capacity(qMax<qint64>(1, expected_items)),
+    _count_items(0)
+{
+    const double ln2 = std::log(2.0);
+    double items = static_cast<double>(_capacity);
+    double rate = qBound(1e-9, false_positive_rate, 0.5);
+
+    _size = static_cast<qint64>(std::ceil(-items * std::log(rate) / (ln2 * ln2)));
+    if(max_bytes > 0)
+    {
+        _size = qMin(_size, max_bytes);
+    }
+    _size = qMax<qint64>(_size, MIN_SIZE);
+    _count_hashes = qBound(1, static_cast<int>(std::lround(static_cast<double>(_size) / items * ln2)), static_cast<int>(MAX_HASHES));
+
+    _counters.reset(new std::atomic<quint8>[static_cast<size_t>(_size)]);
+    for (qint64 i = 0; i < _size; i++)
+    {
+        _counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+CountingBloomFilter::~CountingBloomFilter()
+{
+
+}
+
+// Double hashing: slot i is first + i * second, with second forced odd.
+void CountingBloomFilter::hash(const QString &key, quint64 &first, quint64 &second)const
+{
+    const char *data = reinterpret_cast<const char*>(key.constData());
+    qint64 size = key.size() * static_cast<qint64>(sizeof(QChar));
+    first = Sync::xxhash64(data, size);
+    second = Sync::xxhash64(data, size, SECOND_SEED) | 1;
+}
+
+void CountingBloomFilter::insert(const QString &key)
+{
+    quint64 first = 0;
+    quint64 second = 0;
+    hash(key, first, second);
+    for (int i = 0; i < _count_hashes; i++)
+    {
+        auto &counter = _counters[(first + i * second) % static_cast<quint64>(_size)];
+        quint8 value = counter.load(std::memory_order_relaxed);
+        while(value < MAX_COUNTER && !counter.compare_exchange_weak(value, static_cast<quint8>(value + 1),
+                                                                    std::memory_order_release, std::memory_order_relaxed))
+        {}
+    }
+    _count_items.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountingBloomFilter::remove(const QString &key)
+{
+    quint64 first = 0;
+    quint64 second = 0;
+    hash(key, first, second);
+    for (int i = 0; i < _count_hashes; i++)
+    {
+        auto &counter = _counters[(first + i * second) % static_cast<quint64>(_size)];
+        quint8 value = counter.load(std::memory_order_relaxed);
+        while(value > 0 && value < MAX_COUNTER
+              && !counter.compare_exchange_weak(value, static_cast<quint8>(value - 1),
+                                                std::memory_order_release, std::memory_order_relaxed))
+        {}
+    }
+    _count_items.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool CountingBloomFilter::may_contain(const QString &key)const
+{
+    quint64 first = 0;
+    quint64 second = 0;
+    hash(key, first, second);
+    for (int i = 0; i < _count_hashes; i++)
+    {
+        if(_counters[(first + i * second) % static_cast<quint64>(_size)].load(std::memory_order_acquire) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 CountingBloomFilter::count_items()const
+{
+    return _count_items.load(std::memory_order_relaxed);
+}
+
+qint64 CountingBloomFilter::capacity()const
+{
+    return _capacity;
+}
+
+qint64 CountingBloomFilter::count_bytes()const
+{
+    return _size;
+}
+
+int CountingBloomFilter::count_hashes()const
+{
+    return _count_hashes;
+}
+
+double CountingBloomFilter::expected_false_positive_rate(qint64 items)const
+{
+    double filled = 1.0 - std::exp(-static_cast<double>(_count_hashes) * items / static_cast<double>(_size));
+    return std::pow(filled, _count_hashes);
+}
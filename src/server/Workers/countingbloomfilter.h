@@ -0,0 +1,55 @@
+#ifndef COUNTINGBLOOMFILTER_H
+#define COUNTINGBLOOMFILTER_H
+
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+namespace DataBaseWork
+{
+    // Bloom filter with one 8-bit counter per slot so keys can be removed.
+    // may_contain() never answers false for an inserted key; a counter that
+    // saturates stays pinned, trading a little accuracy for that guarantee.
+    // Counters are atomics, so lookups need no lock while writers update.
+    class CountingBloomFilter
+    {
+    public:
+        static constexpr qint64 MIN_SIZE = 64;
+        static constexpr int MAX_HASHES = 16;
+
+        // max_bytes > 0 caps the table (one byte per counter) at the cost of
+        // a higher false-positive rate.
+        CountingBloomFilter(qint64 expected_items, double false_positive_rate, qint64 max_bytes = 0);
+        CountingBloomFilter(const CountingBloomFilter&) = delete;
+        CountingBloomFilter(const CountingBloomFilter&&) = delete;
+        CountingBloomFilter& operator=(const CountingBloomFilter&) = delete;
+        CountingBloomFilter& operator=(const CountingBloomFilter&&) = delete;
+        virtual ~CountingBloomFilter();
+
+        void insert(const QString &key);
+        void remove(const QString &key);
+        bool may_contain(const QString &key)const;
+
+        // Inserts minus removals; past capacity() the false-positive rate
+        // rises above the one the filter was built for.
+        qint64 count_items()const;
+        qint64 capacity()const;
+        qint64 count_bytes()const;
+        int count_hashes()const;
+        double expected_false_positive_rate(qint64 items)const;
+
+    private:
+        static constexpr quint8 MAX_COUNTER = 0xFF;
+
+        void hash(const QString &key, quint64 &first, quint64 &second)const;
+
+        qint64 _capacity;
+        qint64 _size;
+        int _count_hashes;
+        std::atomic<qint64> _count_items;
+        std::unique_ptr<std::atomic<quint8>[]> _counters;
+    };
+}
+
+#endif // COUNTINGBLOOMFILTER_H
@@ -0,0 +1,219 @@
+#include "Workers/schema.h"
+
+#include <QSqlQuery>
+#include <QDateTime>
+
+using namespace DataBaseWork;
+
+namespace
+{
+    const QStringList CREATE_TABLES_REQUESTS =
+    {
+        "CREATE TABLE users ("
+        "id INTEGER PRIMARY KEY, "
+        "name TEXT NOT NULL UNIQUE);",
+
+        "CREATE TABLE dirs ("
+        "user_id INTEGER NOT NULL REFERENCES users(id) ON DELETE CASCADE, "
+        "path TEXT NOT NULL, "
+        "PRIMARY KEY (user_id, path)) WITHOUT ROWID;",
+
+        "CREATE TABLE files ("
+        "user_id INTEGER NOT NULL REFERENCES users(id) ON DELETE CASCADE, "
+        "path TEXT NOT NULL, "
+        "created INTEGER, "
+        "last_modified INTEGER, "
+        "size INTEGER NOT NULL DEFAULT 0, "
+        "PRIMARY KEY (user_id, path)) WITHOUT ROWID;",
+
+        "CREATE TABLE user_addr_info ("
+        "user_id INTEGER PRIMARY KEY REFERENCES users(id) ON DELETE CASCADE, "
+        "addr TEXT, "
+        "port INTEGER);"
+    };
+
+    const QStringList LEGACY_TABLES = {"users", "dirs", "files", "user_addr_info"};
+    const QStringList LEGACY_COLUMNS = {"name", "name, path", "name, path, created_data, last_modified_data, size",
+                                        "name, port, addr"};
+}
+
+bool Schema::upgrade(QSqlDatabase &base)
+{
+    int current = version(base);
+    if(current == VERSION)
+    {
+        return true;
+    }
+    if(current < 0 || current > VERSION)
+    {
+        return false;
+    }
+
+    if(!base.transaction())
+    {
+        return false;
+    }
+    for (int step = current; step < VERSION; step++)
+    {
+        if(!upgrade_step(base, step))
+        {
+            base.rollback();
+            return false;
+        }
+    }
+    QSqlQuery query(base);
+    if(!query.exec(QString("PRAGMA user_version = %1;").arg(VERSION)) || !base.commit())
+    {
+        base.rollback();
+        return false;
+    }
+    return true;
+}
+
+int Schema::version(QSqlDatabase &base)
+{
+    QSqlQuery query(base);
+    if(!query.exec("PRAGMA user_version;") || !query.next())
+    {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+QVariant Schema::to_epoch(const QString &date)
+{
+    if(date.isEmpty())
+    {
+        return QVariant(QVariant::LongLong);
+    }
+    QDateTime time = QDateTime::fromString(date, Qt::ISODateWithMs);
+    return time.isValid() ? QVariant(time.toMSecsSinceEpoch()) : QVariant(date);
+}
+
+QString Schema::from_epoch(const QVariant &msec)
+{
+    if(msec.isNull())
+    {
+        return QString();
+    }
+    if(msec.type() == QVariant::String)
+    {
+        return msec.toString();
+    }
+    return format_date(QDateTime::fromMSecsSinceEpoch(msec.toLongLong(), Qt::UTC));
+}
+
+QString Schema::format_date(const QDateTime &date)
+{
+    return date.isValid() ? date.toUTC().toString(Qt::ISODateWithMs) : QString();
+}
+
+QString Schema::normalize_date(const QString &date)
+{
+    return from_epoch(to_epoch(date));
+}
+
+bool Schema::upgrade_step(QSqlDatabase &base, int from)
+{
+    switch (from)
+    {
+    case 0:
+        return has_table(base, "users") ? import_legacy_tables(base) : create_tables(base);
+    default:
+        return false;
+    }
+}
+
+bool Schema::create_tables(QSqlDatabase &base)
+{
+    return exec_all(base, CREATE_TABLES_REQUESTS);
+}
+
+// Tables created by hand before versioning was added: every row keyed by the
+// user name, size stored as text and dates as ISO strings. Rows of users that
+// no longer exist were unreachable and are dropped. Dates go through
+// to_epoch(), so any that do not parse are kept as text rather than lost.
+bool Schema::import_legacy_tables(QSqlDatabase &base)
+{
+    QStringList renames;
+    for (int i = 0; i < LEGACY_TABLES.size(); i++)
+    {
+        if(has_table(base, LEGACY_TABLES[i]))
+        {
+            renames += QString("ALTER TABLE %1 RENAME TO legacy_%1;").arg(LEGACY_TABLES[i]);
+        }
+        else
+        {
+            renames += QString("CREATE TABLE legacy_%1 (%2);").arg(LEGACY_TABLES[i], LEGACY_COLUMNS[i]);
+        }
+    }
+    if(!exec_all(base, renames) || !create_tables(base))
+    {
+        return false;
+    }
+
+    if(!exec_all(base, {"INSERT OR IGNORE INTO users (name) SELECT name FROM legacy_users WHERE name IS NOT NULL;",
+                        "INSERT OR IGNORE INTO dirs (user_id,path) "
+                        "SELECT users.id, legacy_dirs.path FROM legacy_dirs JOIN users ON users.name = legacy_dirs.name "
+                        "WHERE legacy_dirs.path IS NOT NULL;",
+                        "INSERT OR REPLACE INTO user_addr_info (user_id,addr,port) "
+                        "SELECT users.id, legacy_user_addr_info.addr, legacy_user_addr_info.port "
+                        "FROM legacy_user_addr_info JOIN users ON users.name = legacy_user_addr_info.name;"}))
+    {
+        return false;
+    }
+
+    QSqlQuery select(base);
+    QSqlQuery insert(base);
+    select.setForwardOnly(true);
+    if(!select.exec("SELECT users.id, legacy_files.path, legacy_files.created_data, "
+                    "legacy_files.last_modified_data, legacy_files.size "
+                    "FROM legacy_files JOIN users ON users.name = legacy_files.name "
+                    "WHERE legacy_files.path IS NOT NULL;")
+            || !insert.prepare("INSERT OR REPLACE INTO files (user_id,path,created,last_modified,size) "
+                               "VALUES (:user_id,:path,:created,:last_modified,:size);"))
+    {
+        return false;
+    }
+    while(select.next())
+    {
+        insert.bindValue(":user_id", select.value(0));
+        insert.bindValue(":path", select.value(1));
+        insert.bindValue(":created", to_epoch(select.value(2).toString()));
+        insert.bindValue(":last_modified", to_epoch(select.value(3).toString()));
+        insert.bindValue(":size", static_cast<qint64>(select.value(4).toString().toDouble()));
+        if(!insert.exec())
+        {
+            return false;
+        }
+    }
+    select.finish();
+
+    QStringList drops;
+    for (auto &table : LEGACY_TABLES)
+    {
+        drops += QString("DROP TABLE legacy_%1;").arg(table);
+    }
+    return exec_all(base, drops);
+}
+
+bool Schema::has_table(QSqlDatabase &base, const QString &table)
+{
+    QSqlQuery query(base);
+    query.prepare("SELECT name FROM sqlite_master WHERE type = 'table' AND name = :name;");
+    query.bindValue(":name", table);
+    return query.exec() && query.next();
+}
+
+bool Schema::exec_all(QSqlDatabase &base, const QStringList &requests)
+{
+    QSqlQuery query(base);
+    for (auto &request : requests)
+    {
+        if(!query.exec(request))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <QSqlDatabase>
+#include <QDateTime>
+#include <QVariant>
+#include <QString>
+#include <QStringList>
+
+namespace DataBaseWork
+{
+    // Creates and upgrades the tables of data.sqlite. PRAGMA user_version
+    // holds the applied version; each upgrade step runs in the same
+    // transaction as the version bump, so a failed step leaves the file as
+    // it was.
+    //
+    // Version 1: integer user ids, files and dirs keyed by (user_id, path),
+    // INTEGER sizes and timestamps in msec since the epoch.
+    //
+    // Dates read back as UTC ISO 8601 with milliseconds, the form
+    // format_date() writes, so a date written in that form compares equal
+    // when read. A date that does not parse is stored as the string itself.
+    class Schema
+    {
+    public:
+        static constexpr int VERSION = 1;
+
+        static bool upgrade(QSqlDatabase &base);
+        static int version(QSqlDatabase &base);
+
+        static QVariant to_epoch(const QString &date);
+        static QString from_epoch(const QVariant &msec);
+        static QString format_date(const QDateTime &date);
+        static QString normalize_date(const QString &date);
+
+    private:
+        static bool upgrade_step(QSqlDatabase &base, int from);
+        static bool create_tables(QSqlDatabase &base);
+        static bool import_legacy_tables(QSqlDatabase &base);
+        static bool has_table(QSqlDatabase &base, const QString &table);
+        static bool exec_all(QSqlDatabase &base, const QStringList &requests);
+    };
+}
+
+#endif // SCHEMA_H
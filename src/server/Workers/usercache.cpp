@@ -0,0 +1,123 @@
+#include "Workers/usercache.h"
+
+using namespace DataBaseWork;
+
+UserCache::UserCache(int max_entries):
+    _max_per_stripe(0)
+{
+    set_max_entries(max_entries);
+}
+
+UserCache::~UserCache()
+{
+
+}
+
+UserCache::Stripe &UserCache::stripe(const QString &user)const
+{
+    return _stripes[qHash(user) % COUNT_STRIPES];
+}
+
+quint64 UserCache::generation(const QString &user)const
+{
+    return stripe(user).generation.load(std::memory_order_acquire);
+}
+
+bool UserCache::find_user(const QString &user, bool &is_user)const
+{
+    Stripe &current = stripe(user);
+    QReadLocker lock(&current.lock);
+    auto found = current.entries.constFind(user);
+    if(found == current.entries.constEnd() || !found->has_user)
+    {
+        return false;
+    }
+    is_user = found->is_user;
+    return true;
+}
+
+void UserCache::store_user(const QString &user, bool is_user, quint64 generation)
+{
+    Stripe &current = stripe(user);
+    QWriteLocker lock(&current.lock);
+    if(Entry *entry = writable_entry(current, user, generation))
+    {
+        entry->has_user = true;
+        entry->is_user = is_user;
+    }
+}
+
+bool UserCache::find_addr_info(const QString &user, AddrInfo &info)const
+{
+    Stripe &current = stripe(user);
+    QReadLocker lock(&current.lock);
+    auto found = current.entries.constFind(user);
+    if(found == current.entries.constEnd() || !found->has_addr_info)
+    {
+        return false;
+    }
+    info = found->addr_info;
+    return true;
+}
+
+void UserCache::store_addr_info(const QString &user, const AddrInfo &info, quint64 generation)
+{
+    Stripe &current = stripe(user);
+    QWriteLocker lock(&current.lock);
+    if(Entry *entry = writable_entry(current, user, generation))
+    {
+        entry->has_addr_info = true;
+        entry->addr_info = info;
+    }
+}
+
+// A full stripe gives up an arbitrary entry, which is enough to bound memory
+// without bookkeeping on the read path.
+UserCache::Entry *UserCache::writable_entry(Stripe &stripe, const QString &user, quint64 generation)
+{
+    if(stripe.generation.load(std::memory_order_acquire) != generation)
+    {
+        return nullptr;
+    }
+
+    int limit = _max_per_stripe.load(std::memory_order_relaxed);
+    if(limit > 0 && stripe.entries.size() >= limit && !stripe.entries.contains(user))
+    {
+        stripe.entries.erase(stripe.entries.begin());
+    }
+    return &stripe.entries[user];
+}
+
+void UserCache::invalidate(const QString &user)
+{
+    Stripe &current = stripe(user);
+    QWriteLocker lock(&current.lock);
+    current.generation.fetch_add(1, std::memory_order_acq_rel);
+    current.entries.remove(user);
+}
+
+void UserCache::clear()
+{
+    for (auto &current : _stripes)
+    {
+        QWriteLocker lock(&current.lock);
+        current.generation.fetch_add(1, std::memory_order_acq_rel);
+        current.entries.clear();
+    }
+}
+
+void UserCache::set_max_entries(int count)
+{
+    _max_per_stripe.store(count > 0 ? qMax(1, count / COUNT_STRIPES) : 0, std::memory_order_relaxed);
+}
+
+int UserCache::count_entries()const
+{
+    int count = 0;
+    for (auto &current : _stripes)
+    {
+        QReadLocker lock(&current.lock);
+        count += current.entries.size();
+    }
+    return count;
+}
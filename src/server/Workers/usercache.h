@@ -0,0 +1,71 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <QString>
+#include <QPair>
+#include <QHash>
+#include <QReadWriteLock>
+
+#include <atomic>
+
+namespace DataBaseWork
+{
+    // Read-through cache in front of the users and user_addr_info lookups.
+    // Entries are spread over independently locked stripes so lookups for
+    // different users rarely meet on a lock. Every invalidation bumps the
+    // stripe's generation; a value read from the database is only stored if
+    // the generation it was read under is still current, so a lookup racing
+    // a write cannot cache the old row.
+    class UserCache
+    {
+    public:
+        using AddrInfo = QPair<QString,quint16>;
+
+        static constexpr int COUNT_STRIPES = 16;
+
+        explicit UserCache(int max_entries = 0);
+        UserCache(const UserCache&) = delete;
+        UserCache(const UserCache&&) = delete;
+        UserCache& operator=(const UserCache&) = delete;
+        UserCache& operator=(const UserCache&&) = delete;
+        virtual ~UserCache();
+
+        quint64 generation(const QString &user)const;
+
+        bool find_user(const QString &user, bool &is_user)const;
+        void store_user(const QString &user, bool is_user, quint64 generation);
+
+        bool find_addr_info(const QString &user, AddrInfo &info)const;
+        void store_addr_info(const QString &user, const AddrInfo &info, quint64 generation);
+
+        void invalidate(const QString &user);
+        void clear();
+
+        void set_max_entries(int count);
+        int count_entries()const;
+
+    private:
+        struct Entry
+        {
+            bool has_user = false;
+            bool is_user = false;
+            bool has_addr_info = false;
+            AddrInfo addr_info;
+        };
+
+        struct Stripe
+        {
+            mutable QReadWriteLock lock;
+            std::atomic<quint64> generation{0};
+            QHash<QString,Entry> entries;
+        };
+
+        Stripe &stripe(const QString &user)const;
+        Entry *writable_entry(Stripe &stripe, const QString &user, quint64 generation);
+
+        std::atomic_int _max_per_stripe;
+        mutable Stripe _stripes[COUNT_STRIPES];
+    };
+}
+
+#endif // USERCACHE_H
@@ -1,4 +1,5 @@
 #include "Workers/workerserverdatabase.h"
+#include "Workers/schema.h"
 
 #include <QSqlQuery>
 #include <QSqlRecord>
@@ -8,7 +9,10 @@
 
 using namespace DataBaseWork;
 
-QMutex WorkerServerDataBase::_data_base_mutex(QMutex::Recursive);
+QMutex WorkerServerDataBase::_observers_mutex;
+QList<WorkerServerDataBase::FileObserver*> WorkerServerDataBase::_file_observers;
+
+constexpr qint64 WorkerServerDataBase::MIN_FILTER_USERS;
 
 const char* WorkerServerDataBase::TYPE_DATA_BASE = "QSQLITE";
 const char* WorkerServerDataBase::DEFAULT_NAME_DATA_BASE = "data.sqlite";
@@ -17,44 +21,99 @@ const char* WorkerServerDataBase::DEFAULT_NAME_CONNECTION_DATA_BASE = "db_connec
 const char* WorkerServerDataBase::INSERT_USER_REQUEST = "INSERT INTO users (name) VALUES (:name);";
 const char* WorkerServerDataBase::DELETE_USER_REQUEST = "DELETE FROM users WHERE name = :name;";
 const char* WorkerServerDataBase::SELECT_USER_REQUEST = "SELECT name FROM users;";
-const char* WorkerServerDataBase::SELECT_ANY_USER_REQUEST = "SELECT name FROM users WHERE name = :name;";
+const char* WorkerServerDataBase::SELECT_ANY_USER_REQUEST = "SELECT id FROM users WHERE name = :name;";
+
+const char* WorkerServerDataBase::INSERT_DIR_REQUEST = "INSERT OR IGNORE INTO dirs (user_id,path) "
+                                                       "SELECT id, :path FROM users WHERE name = :name;";
+const char* WorkerServerDataBase::DELETE_DIR_REQUEST = "DELETE FROM dirs WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+const char* WorkerServerDataBase::SELECT_DIR_REQUEST = "SELECT path FROM dirs WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+
+const char* WorkerServerDataBase::INSERT_FILES_REQUEST = "INSERT OR REPLACE INTO files (user_id,path,created,last_modified,size) "
+                                                         "SELECT id, :path, :created, :last_modified, :size FROM users WHERE name = :name;";
+const char* WorkerServerDataBase::DELETE_FILES_REQUEST = "DELETE FROM files WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+const char* WorkerServerDataBase::DELETE_FILE_REQUEST = "DELETE FROM files WHERE user_id = (SELECT id FROM users WHERE name = :name) "
+                                                        "AND path = :path;";
+const char* WorkerServerDataBase::UPSERT_FILE_REQUEST = "INSERT INTO files (user_id,path,created,last_modified,size) "
+                                                        "SELECT id, :path, :created, :last_modified, :size FROM users WHERE name = :name "
+                                                        "ON CONFLICT (user_id,path) DO UPDATE SET created = excluded.created, "
+                                                        "last_modified = excluded.last_modified, size = excluded.size "
+                                                        "WHERE created IS NOT excluded.created OR last_modified IS NOT excluded.last_modified "
+                                                        "OR size IS NOT excluded.size;";
+const char* WorkerServerDataBase::SELECT_FILES_REQUEST = "SELECT path,created,last_modified,size FROM files "
+                                                         "WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+
+// Everything below a dir: '0' sorts right after '/', so the range covers
+// exactly the paths starting with "<dir>/" and stays an index range scan.
+const char* WorkerServerDataBase::SELECT_DIR_FILES_REQUEST = "SELECT path FROM files "
+                                                             "WHERE user_id = (SELECT id FROM users WHERE name = :name) "
+                                                             "AND path >= :first AND path < :last;";
+const char* WorkerServerDataBase::DELETE_DIR_FILES_REQUEST = "DELETE FROM files "
+                                                             "WHERE user_id = (SELECT id FROM users WHERE name = :name) "
+                                                             "AND path >= :first AND path < :last;";
+
+const char* WorkerServerDataBase::SELECT_FILES_PAGE_REQUEST = "SELECT path,created,last_modified,size FROM files "
+                                                              "WHERE user_id = (SELECT id FROM users WHERE name = :name) "
+                                                              "AND path > :after ORDER BY path LIMIT :limit;";
+
+const char* WorkerServerDataBase::INSERT_ADDR_INFO_USER_REQUEST = "INSERT OR REPLACE INTO user_addr_info (user_id,port,addr) "
+                                                                  "SELECT id, :port, :addr FROM users WHERE name = :name;";
+const char* WorkerServerDataBase::DELETE_ADDR_INFO_REQUEST = "DELETE FROM user_addr_info WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+const char* WorkerServerDataBase::UPDATE_ADDR_USER_REQUEST = "UPDATE user_addr_info SET addr = :addr "
+                                                             "WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+const char* WorkerServerDataBase::UPDATE_PORT_USER_REQUEST = "UPDATE user_addr_info SET port = :port "
+                                                             "WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+const char* WorkerServerDataBase::SELECT_ANY_ADDR_INFO_REQUEST = "SELECT addr, port FROM user_addr_info "
+                                                                 "WHERE user_id = (SELECT id FROM users WHERE name = :name);";
+
+QString WorkerServerDataBase::get_new_name_connection(const QString &prefix)
+{
+    return prefix + QString::number(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+}
 
-const char* WorkerServerDataBase::INSERT_DIR_REQUEST = "INSERT INTO dirs (name,path) VALUES (:name,:path);";
-const char* WorkerServerDataBase::DELETE_DIR_REQUEST = "DELETE FROM dirs WHERE name = :name;";
-const char* WorkerServerDataBase::SELECT_DIR_REQUEST = "SELECT path FROM dirs  WHERE name = :name;";
+void WorkerServerDataBase::remove_connection(const QString &name_connection)
+{
+    QSqlDatabase::removeDatabase(name_connection);
+}
 
-const char* WorkerServerDataBase::INSERT_FILES_REQUEST = "INSERT INTO files (name,path,created_data,last_modified_data,size) "
-                                                         "VALUES (:name,:path,:created_data,:last_modified_data,:size);";
-const char* WorkerServerDataBase::DELETE_FILES_REQUEST = "DELETE FROM files WHERE name = :name;";
-const char* WorkerServerDataBase::SELECT_FILES_REQUEST = "SELECT path,created_data,last_modified_data,size FROM files WHERE name = :name;";
+void WorkerServerDataBase::add_file_observer(FileObserver *observer)
+{
+    QMutexLocker lock(&_observers_mutex);
 
-const char* WorkerServerDataBase::INSERT_ADDR_INFO_USER_REQUEST = "INSERT INTO user_addr_info (name,port,addr) VALUES (:name,:port,:addr);";
-const char* WorkerServerDataBase::DELETE_ADDR_INFO_REQUEST = "DELETE FROM user_addr_info WHERE name = :name;";
-const char* WorkerServerDataBase::UPDATE_ADDR_USER_REQUEST = "UPDATE user_addr_info SET addr = :addr WHERE name = :name;";
-const char* WorkerServerDataBase::UPDATE_PORT_USER_REQUEST = "UPDATE user_addr_info SET port = :port WHERE name = :name;";
-const char* WorkerServerDataBase::SELECT_ANY_ADDR_INFO_REQUEST = "SELECT addr, port FROM user_addr_info WHERE name = :name;";
+    if(observer && !_file_observers.contains(observer))
+    {
+        _file_observers.push_back(observer);
+    }
+}
 
-QString WorkerServerDataBase::get_new_name_connection()
+void WorkerServerDataBase::remove_file_observer(FileObserver *observer)
 {
-    int id = 0;
-    auto temp = QThread::currentThreadId();
-    memcpy(&id,&temp,sizeof (id));
-    return DEFAULT_NAME_CONNECTION_DATA_BASE + QString::number(id);
+    QMutexLocker lock(&_observers_mutex);
+
+    _file_observers.removeAll(observer);
 }
 
-void WorkerServerDataBase::remove_connection(const QString &name_connection)
+// The form get_data_files_user() returns for data written as given.
+WorkerServerDataBase::FileCharacteristics WorkerServerDataBase::normalized(const FileCharacteristics &data)
 {
-    QSqlDatabase::removeDatabase(name_connection);
+    return std::make_tuple(std::get<INDEX_SIZE>(data),
+                           Schema::normalize_date(std::get<INDEX_CREATED>(data)),
+                           Schema::normalize_date(std::get<INDEX_LAST_MODIFIED>(data)));
+}
+
+QList<WorkerServerDataBase::FileObserver*> WorkerServerDataBase::file_observers()
+{
+    QMutexLocker lock(&_observers_mutex);
+
+    return _file_observers;
 }
 
 QStringList WorkerServerDataBase::get_all_user()const
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QSqlDatabase base = _pool.local();
 
     QStringList res;
-    QSqlQuery query(_base);
-    query.prepare(SELECT_USER_REQUEST);
-    if(_base.isOpen() && query.exec())
+    QSqlQuery &query = _pool.statement(SELECT_USER_REQUEST);
+    if(base.isOpen() && query.exec())
     {
         while(query.next())
         {
@@ -66,73 +125,115 @@ QStringList WorkerServerDataBase::get_all_user()const
 
 bool WorkerServerDataBase::insert_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
+
+    if(auto filter = std::atomic_load(&_user_filter))
+    {
+        filter->insert(user);
+    }
 
-    QSqlQuery query(_base);
-    query.prepare(INSERT_USER_REQUEST);
+    QSqlQuery &query = _pool.statement(INSERT_USER_REQUEST);
     query.bindValue(":name",user);
-    if(!_base.isOpen() || !query.exec())
+    if(!base.isOpen() || !query.exec())
     {
         return false;
     }
+    invalidate_user(user);
+    // Inside a transaction the listing may still lose rows to a rollback, so
+    // the rebuild waits for the next insert outside one.
+    auto filter = std::atomic_load(&_user_filter);
+    if(filter && filter->count_items() > filter->capacity() && _pool.depth() == 0)
+    {
+        build_user_filter();
+    }
     return true;
 }
 
 bool WorkerServerDataBase::delete_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    QSqlQuery query(_base);
-    query.prepare(DELETE_USER_REQUEST);
+    QSqlQuery &query = _pool.statement(DELETE_USER_REQUEST);
     query.bindValue(":name",user);
-    if(!_base.isOpen() || !is_user(user) || !query.exec())
+    if(!base.isOpen() || !is_user(user) || !query.exec())
     {
         return false;
     }
+    invalidate_user(user);
+    // A deletion inside a transaction may still be rolled back; leaving the
+    // name in the filter only costs a query.
+    auto filter = std::atomic_load(&_user_filter);
+    if(filter && _pool.depth() == 0 && query.numRowsAffected() > 0)
+    {
+        filter->remove(user);
+    }
+    for (auto observer : file_observers())
+    {
+        observer->files_removed(user);
+    }
     return true;
 }
 
 bool WorkerServerDataBase::is_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
-
-    QSqlQuery query(_base);
-    query.prepare(SELECT_ANY_USER_REQUEST);
-    query.bindValue(":name",user);
-    if(!_base.isOpen() || !query.exec())
+    auto filter = std::atomic_load(&_user_filter);
+    if(filter && !filter->may_contain(user))
     {
         return false;
     }
-    else
+
+    bool is_found = false;
+    if(_cache.find_user(user, is_found))
     {
-        if(!query.next())
-        {
-            return false;
-        }
-        return true;
+        return is_found;
     }
+
+    quint64 generation = _cache.generation(user);
+    QSqlDatabase base = _pool.local();
+    QSqlQuery &query = _pool.statement(SELECT_ANY_USER_REQUEST);
+    query.bindValue(":name",user);
+    if(!base.isOpen() || !query.exec())
+    {
+        return false;
+    }
+    is_found = query.next();
+    query.finish();
+    _cache.store_user(user, is_found, generation);
+    return is_found;
 }
 
 bool WorkerServerDataBase::insert_data_dir_user(const QString &user,const QStringList &dirs)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen() && is_user(user))
+    if(base.isOpen() && is_user(user))
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(INSERT_DIR_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(INSERT_DIR_REQUEST);
         for(auto &dir : dirs)
         {
             query.bindValue(":name",user);
             query.bindValue(":path",dir);
             if(!query.exec())
             {
-                _base.rollback();
+                _pool.rollback();
                 return false;
             }
         }
-        _base.commit();
+        if(!_pool.commit())
+        {
+            return false;
+        }
+        for (auto observer : file_observers())
+        {
+            observer->dirs_changed(user);
+        }
         return true;
     }
     return false;
@@ -140,20 +241,30 @@ bool WorkerServerDataBase::insert_data_dir_user(const QString &user,const QStrin
 
 bool WorkerServerDataBase::delete_data_dir_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen())
+    if(base.isOpen())
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(DELETE_DIR_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(DELETE_DIR_REQUEST);
         query.bindValue(":name",user);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
+            return false;
+        }
+        if(!_pool.commit())
+        {
             return false;
         }
-        _base.commit();
+        for (auto observer : file_observers())
+        {
+            observer->dirs_changed(user);
+        }
         return true;
     }
     return false;
@@ -161,13 +272,12 @@ bool WorkerServerDataBase::delete_data_dir_user(const QString &user)
 
 WorkerServerDataBase::DirsPath WorkerServerDataBase::get_data_dir_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QSqlDatabase base = _pool.local();
 
     QStringList res;
-    QSqlQuery query(_base);
-    query.prepare(SELECT_DIR_REQUEST);
+    QSqlQuery &query = _pool.statement(SELECT_DIR_REQUEST);
     query.bindValue(":name",user);
-    if(_base.isOpen() && query.exec())
+    if(base.isOpen() && query.exec())
     {
         while(query.next())
         {
@@ -179,28 +289,43 @@ WorkerServerDataBase::DirsPath WorkerServerDataBase::get_data_dir_user(const QSt
 
 bool WorkerServerDataBase::insert_data_files_user(const QString &user,const WorkerServerDataBase::FileMetaData &data)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen() && is_user(user))
+    if(base.isOpen() && is_user(user))
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(INSERT_FILES_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(INSERT_FILES_REQUEST);
         for(auto it = data.begin(); it != data.end(); it++)
         {
             query.bindValue(":name",user);
             query.bindValue(":path",it.key());
-            query.bindValue(":created_data",std::get<INDEX_CREATED>(it.value()));
-            query.bindValue(":last_modified_data",std::get<INDEX_LAST_MODIFIED>(it.value()));
-            query.bindValue(":size",QString::number(std::get<INDEX_SIZE>(it.value())));
+            query.bindValue(":created",Schema::to_epoch(std::get<INDEX_CREATED>(it.value())));
+            query.bindValue(":last_modified",Schema::to_epoch(std::get<INDEX_LAST_MODIFIED>(it.value())));
+            query.bindValue(":size",static_cast<qint64>(std::get<INDEX_SIZE>(it.value())));
 
             if(!query.exec())
             {
-                _base.rollback();
+                _pool.rollback();
                 return false;
             }
         }
-        _base.commit();
+        if(!_pool.commit())
+        {
+            return false;
+        }
+        FileMetaData stored;
+        for(auto it = data.begin(); it != data.end(); it++)
+        {
+            stored.insert(stored.constEnd(), it.key(), normalized(it.value()));
+        }
+        for (auto observer : file_observers())
+        {
+            observer->files_changed(user, stored);
+        }
         return true;
     }
     return false;
@@ -208,41 +333,204 @@ bool WorkerServerDataBase::insert_data_files_user(const QString &user,const Work
 
 bool WorkerServerDataBase::delete_data_files_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen())
+    if(base.isOpen())
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(DELETE_FILES_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(DELETE_FILES_REQUEST);
         query.bindValue(":name",user);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
+            return false;
+        }
+        if(!_pool.commit())
+        {
+            return false;
+        }
+        for (auto observer : file_observers())
+        {
+            observer->files_removed(user);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool WorkerServerDataBase::apply_file_changes(const QString &user, const FileMetaData &added,
+                                              const FileMetaData &modified, const QStringList &removed)
+{
+    QStringList deleted;
+    return apply_file_changes(user, added, modified, removed, QStringList(), deleted);
+}
+
+// removed_dirs drops every row below each dir. deleted gets the paths whose
+// rows were actually removed, so callers need not read the listing first.
+bool WorkerServerDataBase::apply_file_changes(const QString &user, const FileMetaData &added, const FileMetaData &modified,
+                                              const QStringList &removed, const QStringList &removed_dirs, QStringList &deleted)
+{
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
+
+    if(base.isOpen() && is_user(user))
+    {
+        if(!_pool.transaction())
+        {
             return false;
         }
-        _base.commit();
+        QSqlQuery &delete_query = _pool.statement(DELETE_FILE_REQUEST);
+        QSqlQuery &upsert_query = _pool.statement(UPSERT_FILE_REQUEST);
+        QSqlQuery &select_dir_query = _pool.statement(SELECT_DIR_FILES_REQUEST);
+        QSqlQuery &delete_dir_query = _pool.statement(DELETE_DIR_FILES_REQUEST);
+
+        deleted.clear();
+        for(auto &dir : removed_dirs)
+        {
+            for(auto query : {&select_dir_query, &delete_dir_query})
+            {
+                query->bindValue(":name",user);
+                query->bindValue(":first",dir + '/');
+                query->bindValue(":last",dir + '0');
+            }
+            if(!select_dir_query.exec())
+            {
+                _pool.rollback();
+                return false;
+            }
+            while(select_dir_query.next())
+            {
+                deleted.append(select_dir_query.value(0).toString());
+            }
+            if(!delete_dir_query.exec())
+            {
+                _pool.rollback();
+                return false;
+            }
+        }
+        for(auto &path : removed)
+        {
+            delete_query.bindValue(":name",user);
+            delete_query.bindValue(":path",path);
+            if(!delete_query.exec())
+            {
+                _pool.rollback();
+                return false;
+            }
+            if(delete_query.numRowsAffected() > 0)
+            {
+                deleted.append(path);
+            }
+        }
+
+        FileMetaData changed;
+        for(auto data : {&added, &modified})
+        {
+            for(auto it = data->begin(); it != data->end(); it++)
+            {
+                upsert_query.bindValue(":name",user);
+                upsert_query.bindValue(":path",it.key());
+                upsert_query.bindValue(":created",Schema::to_epoch(std::get<INDEX_CREATED>(it.value())));
+                upsert_query.bindValue(":last_modified",Schema::to_epoch(std::get<INDEX_LAST_MODIFIED>(it.value())));
+                upsert_query.bindValue(":size",static_cast<qint64>(std::get<INDEX_SIZE>(it.value())));
+                if(!upsert_query.exec())
+                {
+                    _pool.rollback();
+                    return false;
+                }
+                if(upsert_query.numRowsAffected() > 0)
+                {
+                    changed.insert(it.key(), normalized(it.value()));
+                }
+            }
+        }
+        if(!_pool.commit())
+        {
+            return false;
+        }
+        for (auto observer : file_observers())
+        {
+            if(!deleted.isEmpty())
+            {
+                observer->file_paths_removed(user, deleted);
+            }
+            if(!changed.isEmpty())
+            {
+                observer->files_changed(user, changed);
+            }
+        }
         return true;
     }
     return false;
 }
 
+// The writer lane is held from the read to the apply so no other writer can
+// commit in between and be undone by a stale diff.
+bool WorkerServerDataBase::replace_data_files_user(const QString &user, const FileMetaData &data)
+{
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    FileMetaData added;
+    FileMetaData modified;
+    QStringList removed;
+    diff_files(get_data_files_user(user), data, added, modified, removed);
+    if(added.isEmpty() && modified.isEmpty() && removed.isEmpty())
+    {
+        return is_user(user);
+    }
+    return apply_file_changes(user, added, modified, removed);
+}
+
+// Both maps iterate in key order, so one merge pass over the two listings
+// classifies every path. Dates are compared as they would be stored, so a
+// different spelling of the same instant is not a change.
+void WorkerServerDataBase::diff_files(const FileMetaData &stored, const FileMetaData &current,
+                                      FileMetaData &added, FileMetaData &modified, QStringList &removed)
+{
+    auto old_it = stored.constBegin();
+    auto new_it = current.constBegin();
+    while(old_it != stored.constEnd() || new_it != current.constEnd())
+    {
+        if(new_it == current.constEnd() || (old_it != stored.constEnd() && old_it.key() < new_it.key()))
+        {
+            removed.append(old_it.key());
+            old_it++;
+        }
+        else if(old_it == stored.constEnd() || new_it.key() < old_it.key())
+        {
+            added.insert(added.constEnd(), new_it.key(), new_it.value());
+            new_it++;
+        }
+        else
+        {
+            if(old_it.value() != new_it.value() && normalized(old_it.value()) != normalized(new_it.value()))
+            {
+                modified.insert(modified.constEnd(), new_it.key(), new_it.value());
+            }
+            old_it++;
+            new_it++;
+        }
+    }
+}
+
 WorkerServerDataBase::FileMetaData WorkerServerDataBase::get_data_files_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QSqlDatabase base = _pool.local();
 
     FileMetaData res;
-    QSqlQuery query(_base);
-    query.prepare(SELECT_FILES_REQUEST);
+    QSqlQuery &query = _pool.statement(SELECT_FILES_REQUEST);
     query.bindValue(":name",user);
-    if(_base.isOpen() && query.exec())
+    if(base.isOpen() && query.exec())
     {
         while(query.next())
         {
             auto path = query.value("path").toString();
-            quint64 size = static_cast<quint64>(query.value("size").toString().toDouble());
-            auto created_data = query.value("created_data").toString();
-            auto last_modified_data = query.value("last_modified_data").toString();
+            quint64 size = static_cast<quint64>(query.value("size").toLongLong());
+            auto created_data = Schema::from_epoch(query.value("created"));
+            auto last_modified_data = Schema::from_epoch(query.value("last_modified"));
             FileCharacteristics data = std::make_tuple(size,created_data,last_modified_data);
             res.insert(path,data);
         }
@@ -250,135 +538,315 @@ WorkerServerDataBase::FileMetaData WorkerServerDataBase::get_data_files_user(con
     return res;
 }
 
-bool WorkerServerDataBase::is_user_info(const QString &user)
+// Returns the number of rows visited, or -1 on error.
+int WorkerServerDataBase::read_files_page(const QString &user, const QString &after, int limit, const FileVisitor &visitor)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QSqlDatabase base = _pool.local();
 
+    QSqlQuery &query = _pool.statement(SELECT_FILES_PAGE_REQUEST);
+    query.bindValue(":name",user);
+    query.bindValue(":after",after.isNull() ? QStringLiteral("") : after);
+    query.bindValue(":limit",limit);
+    if(!base.isOpen() || !query.exec())
+    {
+        return -1;
+    }
+
+    int count = 0;
+    while(query.next())
+    {
+        FileCharacteristics data = std::make_tuple(static_cast<quint64>(query.value(3).toLongLong()),
+                                                   Schema::from_epoch(query.value(1)),
+                                                   Schema::from_epoch(query.value(2)));
+        visitor(query.value(0).toString(), data);
+        count++;
+    }
+    return count;
+}
+
+FileCursor::FileCursor(WorkerServerDataBase &data_base, const QString &user, int page_size):
+    _data_base(data_base),
+    _user(user),
+    _page_size(qMax(1, page_size)),
+    _is_done(false)
+{}
+
+bool FileCursor::next_page(const WorkerServerDataBase::FileVisitor &visitor)
+{
+    if(_is_done)
+    {
+        return false;
+    }
+
+    int count = _data_base.read_files_page(_user, _position, _page_size,
+                                           [this, &visitor](const QString &path, const WorkerServerDataBase::FileCharacteristics &data)
+    {
+        _position = path;
+        visitor(path, data);
+    });
+    if(count < _page_size)
+    {
+        _is_done = true;
+    }
+    return count >= 0;
+}
+
+bool FileCursor::is_done()const
+{
+    return _is_done;
+}
+
+QString FileCursor::position()const
+{
+    return _position;
+}
+
+bool WorkerServerDataBase::is_user_info(const QString &user)
+{
     return get_addr_info_user(user).first == "null" ? false : true;
 }
 
 bool WorkerServerDataBase::insert_addr_info_user(const QString &user,const QString &addr, quint16 port)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen() && is_user(user))
+    if(base.isOpen() && is_user(user))
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(INSERT_ADDR_INFO_USER_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(INSERT_ADDR_INFO_USER_REQUEST);
         query.bindValue(":name",user);
         query.bindValue(":port",port);
         query.bindValue(":addr",addr);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
             return false;
         }
-        _base.commit();
-        return true;
+        bool is_committed = _pool.commit();
+        invalidate_user(user);
+        return is_committed;
     }
     return false;
 }
 
 bool WorkerServerDataBase::change_addr_user(const QString &user,const QString &addr)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen() && is_user(user))
+    if(base.isOpen() && is_user(user))
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(UPDATE_ADDR_USER_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(UPDATE_ADDR_USER_REQUEST);
         query.bindValue(":name",user);
         query.bindValue(":addr",addr);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
             return false;
         }
-        _base.commit();
-        return true;
+        bool is_committed = _pool.commit();
+        invalidate_user(user);
+        return is_committed;
     }
     return false;
 }
 
 bool WorkerServerDataBase::change_port_user(const QString &user,quint16 port)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen() && is_user(user))
+    if(base.isOpen() && is_user(user))
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(UPDATE_PORT_USER_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(UPDATE_PORT_USER_REQUEST);
         query.bindValue(":name",user);
         query.bindValue(":port",port);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
             return false;
         }
-        _base.commit();
-        return true;
+        bool is_committed = _pool.commit();
+        invalidate_user(user);
+        return is_committed;
     }
     return false;
 }
 
 bool WorkerServerDataBase::delete_addr_info_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
 
-    if(_base.isOpen())
+    if(base.isOpen())
     {
-        _base.transaction();
-        QSqlQuery query(_base);
-        query.prepare(DELETE_ADDR_INFO_REQUEST);
+        if(!_pool.transaction())
+        {
+            return false;
+        }
+        QSqlQuery &query = _pool.statement(DELETE_ADDR_INFO_REQUEST);
         query.bindValue(":name",user);
         if(!query.exec())
         {
-            _base.rollback();
+            _pool.rollback();
             return false;
         }
-        _base.commit();
-        return true;
+        bool is_committed = _pool.commit();
+        invalidate_user(user);
+        return is_committed;
     }
     return false;
 }
 
 QPair<QString,quint16> WorkerServerDataBase::get_addr_info_user(const QString &user)
 {
-    QMutexLocker lock(&_data_base_mutex);
-
     QPair<QString,quint16> res("null",0);
-    QSqlQuery query(_base);
-    query.prepare(SELECT_ANY_ADDR_INFO_REQUEST);
+    if(_cache.find_addr_info(user, res))
+    {
+        return res;
+    }
+
+    quint64 generation = _cache.generation(user);
+    QSqlDatabase base = _pool.local();
+    QSqlQuery &query = _pool.statement(SELECT_ANY_ADDR_INFO_REQUEST);
     query.bindValue(":name",user);
-    if(_base.isOpen() && query.exec())
+    if(base.isOpen() && query.exec())
     {
         if(query.next())
         {
             res.first = query.value("addr").toString();
             res.second = static_cast<quint16>(query.value("port").toInt());
         }
+        query.finish();
+        _cache.store_addr_info(user, res, generation);
     }
     return res;
 }
 
-WorkerServerDataBase::WorkerServerDataBase(const QString &connection_name)
+WorkerServerDataBase::WorkerServerDataBase(const QString &connection_name):
+    _pool(TYPE_DATA_BASE, DEFAULT_NAME_DATA_BASE, connection_name),
+    _user_filter_rate(0),
+    _user_filter_max_bytes(0),
+    _is_ready(false)
+{
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    QSqlDatabase base = _pool.local();
+    _is_ready = base.isOpen() && Schema::upgrade(base);
+}
+
+bool WorkerServerDataBase::is_ready()const
+{
+    return _is_ready;
+}
+
+bool WorkerServerDataBase::transaction()
+{
+    ConnectionPool::writer_lane().lock();
+    if(!_pool.transaction())
+    {
+        ConnectionPool::writer_lane().unlock();
+        return false;
+    }
+    return true;
+}
+
+bool WorkerServerDataBase::commit()
+{
+    bool is_committed = _pool.commit();
+    release_invalidations();
+    ConnectionPool::writer_lane().unlock();
+    return is_committed;
+}
+
+void WorkerServerDataBase::rollback()
+{
+    _pool.rollback();
+    release_invalidations();
+    ConnectionPool::writer_lane().unlock();
+}
+
+void WorkerServerDataBase::set_cache_size(int max_entries)
+{
+    _cache.set_max_entries(max_entries);
+}
+
+// Built under the writer lane so no user can be added between reading the
+// names and publishing the filter.
+bool WorkerServerDataBase::enable_user_filter(double false_positive_rate, qint64 max_bytes)
+{
+    QMutexLocker lock(&ConnectionPool::writer_lane());
+    _user_filter_rate = false_positive_rate;
+    _user_filter_max_bytes = max_bytes;
+    return build_user_filter();
+}
+
+// Called with the writer lane held. Readers keep using the old filter until
+// the new one is published.
+bool WorkerServerDataBase::build_user_filter()
 {
-    if(QSqlDatabase::contains(connection_name))
+    if(!_pool.local().isOpen())
     {
-        QSqlDatabase::database(connection_name);
+        return false;
     }
-    else
+
+    auto users = get_all_user();
+    auto filter = std::make_shared<CountingBloomFilter>(qMax(2 * static_cast<qint64>(users.size()), MIN_FILTER_USERS),
+                                                        _user_filter_rate, _user_filter_max_bytes);
+    for (auto &user : users)
     {
-        _base = QSqlDatabase::addDatabase(TYPE_DATA_BASE,connection_name);
-        _base.setDatabaseName(DEFAULT_NAME_DATA_BASE);
-        _base.open();
+        filter->insert(user);
     }
+    std::atomic_store(&_user_filter, filter);
+    return true;
+}
+
+void WorkerServerDataBase::disable_user_filter()
+{
+    std::atomic_store(&_user_filter, std::shared_ptr<CountingBloomFilter>());
+}
+
+// Inside an open transaction other connections still read the old row and
+// may cache it again, so the entry is dropped once more after the outermost
+// commit.
+void WorkerServerDataBase::invalidate_user(const QString &user)
+{
+    _cache.invalidate(user);
+    if(_pool.depth() > 0)
+    {
+        if(!_invalidations.hasLocalData())
+        {
+            _invalidations.setLocalData(new QStringList);
+        }
+        _invalidations.localData()->append(user);
+    }
+}
+
+void WorkerServerDataBase::release_invalidations()
+{
+    if(_pool.depth() > 0 || !_invalidations.hasLocalData())
+    {
+        return;
+    }
+    for (auto &user : *_invalidations.localData())
+    {
+        _cache.invalidate(user);
+    }
+    _invalidations.localData()->clear();
 }
 
 WorkerServerDataBase::~WorkerServerDataBase()
 {
-    _base.close();
+
 }
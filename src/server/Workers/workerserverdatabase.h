@@ -5,9 +5,21 @@
 #include <QStringList>
 #include <QMap>
 #include <QMutex>
+#include <QThreadStorage>
+
+#include <functional>
+#include <memory>
+
+#include "Workers/connectionpool.h"
+#include "Workers/usercache.h"
+#include "Workers/countingbloomfilter.h"
 
 namespace DataBaseWork
 {
+    // Safe to share between threads: every thread works on its own pooled
+    // connection, reads run concurrently and writes take the writer lane.
+    // The constructor brings data.sqlite up to Schema::VERSION; deleting a
+    // user cascades to its dirs, files and address info.
     class WorkerServerDataBase
     {
     public:
@@ -15,10 +27,40 @@ namespace DataBaseWork
         using FileCharacteristics = std::tuple<quint64,QString,QString>;
         using FileMetaData = QMap<QString,FileCharacteristics>;
         using DirsPath = QStringList;
+        using FileVisitor = std::function<void(const QString &path, const FileCharacteristics &data)>;
+
+        class FileObserver
+        {
+        public:
+            virtual ~FileObserver() = default;
+            virtual void files_changed(const QString &user, const FileMetaData &data) { Q_UNUSED(user); Q_UNUSED(data); }
+            virtual void files_removed(const QString &user) { Q_UNUSED(user); }
+            virtual void file_paths_removed(const QString &user, const QStringList &paths) { Q_UNUSED(user); Q_UNUSED(paths); }
+            virtual void dirs_changed(const QString &user) { Q_UNUSED(user); }
+        };
 
         WorkerServerDataBase(const QString &connection_name = DEFAULT_NAME_CONNECTION_DATA_BASE);
         virtual ~WorkerServerDataBase();
 
+        bool is_ready()const;
+
+        // Groups the following calls of this thread into one transaction,
+        // holding the writer lane until the matching commit() or rollback().
+        // Calls nest.
+        bool transaction();
+        bool commit();
+        void rollback();
+
+        // 0 leaves the user cache unbounded.
+        void set_cache_size(int max_entries);
+
+        // Builds a filter of all user names so is_user() rejects most unknown
+        // names without a query. It is sized for twice the current users and
+        // rebuilt the same way once insert_user() fills it; max_bytes > 0
+        // caps it.
+        bool enable_user_filter(double false_positive_rate, qint64 max_bytes = 0);
+        void disable_user_filter();
+
         bool insert_user(const QString &user);
         bool delete_user(const QString &user);
         bool is_user(const QString &user);
@@ -30,7 +72,13 @@ namespace DataBaseWork
 
         bool insert_data_files_user(const QString &user, const FileMetaData &data);
         bool delete_data_files_user(const QString &user);
+        bool apply_file_changes(const QString &user, const FileMetaData &added,
+                                const FileMetaData &modified, const QStringList &removed);
+        bool apply_file_changes(const QString &user, const FileMetaData &added, const FileMetaData &modified,
+                                const QStringList &removed, const QStringList &removed_dirs, QStringList &deleted);
+        bool replace_data_files_user(const QString &user, const FileMetaData &data);
         FileMetaData get_data_files_user(const QString &user);
+        int read_files_page(const QString &user, const QString &after, int limit, const FileVisitor &visitor);
 
         bool insert_addr_info_user(const QString &user,const QString &addr, quint16 port);
         bool is_user_info(const QString &user);
@@ -39,13 +87,33 @@ namespace DataBaseWork
         bool delete_addr_info_user(const QString &user);
         QPair<QString,quint16> get_addr_info_user(const QString &user);
 
-        static QString get_new_name_connection();
+        static QString get_new_name_connection(const QString &prefix = DEFAULT_NAME_CONNECTION_DATA_BASE);
         static void remove_connection(const QString &name_connection = DEFAULT_NAME_CONNECTION_DATA_BASE);
 
+        static void diff_files(const FileMetaData &stored, const FileMetaData &current,
+                               FileMetaData &added, FileMetaData &modified, QStringList &removed);
+
+        static void add_file_observer(FileObserver *observer);
+        static void remove_file_observer(FileObserver *observer);
+
     private:
-        QSqlDatabase _base;
+        static QList<FileObserver*> file_observers();
+        static FileCharacteristics normalized(const FileCharacteristics &data);
+
+        void invalidate_user(const QString &user);
+        bool build_user_filter();
+        void release_invalidations();
 
-        static QMutex _data_base_mutex;
+        ConnectionPool _pool;
+        UserCache _cache;
+        std::shared_ptr<CountingBloomFilter> _user_filter;
+        double _user_filter_rate;
+        qint64 _user_filter_max_bytes;
+        QThreadStorage<QStringList*> _invalidations;
+        bool _is_ready;
+
+        static QMutex _observers_mutex;
+        static QList<FileObserver*> _file_observers;
 
         static const char* DEFAULT_NAME_DATA_BASE;
         static const char* TYPE_DATA_BASE;
@@ -62,7 +130,12 @@ namespace DataBaseWork
 
         static const char* INSERT_FILES_REQUEST;
         static const char* DELETE_FILES_REQUEST;
+        static const char* DELETE_FILE_REQUEST;
+        static const char* UPSERT_FILE_REQUEST;
         static const char* SELECT_FILES_REQUEST;
+        static const char* SELECT_FILES_PAGE_REQUEST;
+        static const char* SELECT_DIR_FILES_REQUEST;
+        static const char* DELETE_DIR_FILES_REQUEST;
 
         static const char* INSERT_ADDR_INFO_USER_REQUEST;
         static const char* UPDATE_ADDR_USER_REQUEST;
@@ -73,6 +146,30 @@ namespace DataBaseWork
         static constexpr int INDEX_SIZE = 0;
         static constexpr int INDEX_CREATED = 1;
         static constexpr int INDEX_LAST_MODIFIED = 2;
+        static constexpr qint64 MIN_FILTER_USERS = 1024;
+    };
+
+    // Walks a user's files in path order, one page per query. Each page
+    // resumes after the last path seen (keyset pagination), so it is an index
+    // range scan whatever the position, and rows go to the visitor without
+    // being collected.
+    class FileCursor
+    {
+    public:
+        static constexpr int DEFAULT_PAGE_SIZE = 1024;
+
+        FileCursor(WorkerServerDataBase &data_base, const QString &user, int page_size = DEFAULT_PAGE_SIZE);
+
+        bool next_page(const WorkerServerDataBase::FileVisitor &visitor);
+        bool is_done()const;
+        QString position()const;
+
+    private:
+        WorkerServerDataBase &_data_base;
+        QString _user;
+        QString _position;
+        int _page_size;
+        bool _is_done;
     };
 }
 
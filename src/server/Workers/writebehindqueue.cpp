@@ -0,0 +1,163 @@
+#include "Workers/writebehindqueue.h"
+
+namespace ao = ActiveObject;
+
+using namespace DataBaseWork;
+
+namespace
+{
+    template<typename Core>
+    class FlushTask : public ao::AbstractTask
+    {
+    public:
+        explicit FlushTask(const std::shared_ptr<Core> &core):
+            _core(core)
+        {}
+
+        void run_process() override
+        {
+            if(auto core = _core.lock())
+            {
+                core->flush();
+            }
+        }
+
+    private:
+        std::weak_ptr<Core> _core;
+    };
+}
+
+WriteBehindQueue::Core::Core(WorkerServerDataBase &base, int window, int batch):
+    data_base(base),
+    window_msec(window),
+    max_batch(batch)
+{}
+
+WriteBehindQueue::WriteBehindQueue(WorkerServerDataBase &data_base, ao::ProxyActiveObject &workers,
+                                   int window_msec, int max_batch):
+    _core(std::make_shared<Core>(data_base, qMax(0, window_msec), qMax(1, max_batch))),
+    _workers(workers)
+{}
+
+WriteBehindQueue::~WriteBehindQueue()
+{
+    flush();
+}
+
+void WriteBehindQueue::insert_addr_info_user(const QString &user, const QString &addr, quint16 port, Completion done)
+{
+    enqueue(user, [&](Mutation &mutation)
+    {
+        mutation.is_insert = true;
+        mutation.has_addr = mutation.has_port = true;
+        mutation.addr = addr;
+        mutation.port = port;
+    }, done);
+}
+
+void WriteBehindQueue::change_addr_user(const QString &user, const QString &addr, Completion done)
+{
+    enqueue(user, [&](Mutation &mutation)
+    {
+        mutation.has_addr = true;
+        mutation.addr = addr;
+    }, done);
+}
+
+void WriteBehindQueue::change_port_user(const QString &user, quint16 port, Completion done)
+{
+    enqueue(user, [&](Mutation &mutation)
+    {
+        mutation.has_port = true;
+        mutation.port = port;
+    }, done);
+}
+
+void WriteBehindQueue::flush()
+{
+    _core->flush();
+}
+
+int WriteBehindQueue::count_pending()const
+{
+    QMutexLocker lock(&_core->mutex);
+    return _core->pending.size();
+}
+
+void WriteBehindQueue::enqueue(const QString &user, const std::function<void(Mutation&)> &merge, Completion done)
+{
+    QMutexLocker lock(&_core->mutex);
+    Mutation &mutation = _core->pending[user];
+    merge(mutation);
+    if(done)
+    {
+        mutation.completions.append(done);
+    }
+
+    if(_core->pending.size() >= _core->max_batch)
+    {
+        _workers.push(new FlushTask<Core>(_core));
+    }
+    else if(!_core->is_scheduled)
+    {
+        _core->is_scheduled = true;
+        _workers.push(new FlushTask<Core>(_core), _core->window_msec);
+    }
+}
+
+// flush_mutex is taken before the swap and held through the commit, so a
+// later batch can never commit ahead of an earlier one. Completions run
+// after it is released.
+void WriteBehindQueue::Core::flush()
+{
+    QMutexLocker flush_lock(&flush_mutex);
+    QHash<QString,Mutation> batch;
+    {
+        QMutexLocker lock(&mutex);
+        batch.swap(pending);
+        is_scheduled = false;
+    }
+    if(batch.isEmpty())
+    {
+        return;
+    }
+
+    QHash<QString,bool> results;
+    bool is_committed = data_base.transaction();
+    if(is_committed)
+    {
+        for (auto it = batch.constBegin(); it != batch.constEnd(); it++)
+        {
+            results.insert(it.key(), apply(it.key(), it.value()));
+        }
+        is_committed = data_base.commit();
+    }
+    flush_lock.unlock();
+
+    for (auto it = batch.constBegin(); it != batch.constEnd(); it++)
+    {
+        bool is_done = is_committed && results.value(it.key());
+        for (auto &done : it.value().completions)
+        {
+            done(is_done);
+        }
+    }
+}
+
+bool WriteBehindQueue::Core::apply(const QString &user, const Mutation &mutation)
+{
+    if(mutation.is_insert)
+    {
+        return data_base.insert_addr_info_user(user, mutation.addr, mutation.port);
+    }
+    bool is_applied = true;
+    if(mutation.has_addr)
+    {
+        is_applied = data_base.change_addr_user(user, mutation.addr);
+    }
+    if(is_applied && mutation.has_port)
+    {
+        is_applied = data_base.change_port_user(user, mutation.port);
+    }
+    return is_applied;
+}
@@ -0,0 +1,79 @@
+#ifndef WRITEBEHINDQUEUE_H
+#define WRITEBEHINDQUEUE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+#include <functional>
+#include <memory>
+
+#include "ActiveObject/proxyactiveobject.h"
+#include "Workers/workerserverdatabase.h"
+
+namespace DataBaseWork
+{
+    // Defers address updates and commits them in groups on the scheduler.
+    // Writes for one user collapse into a single row update; a group is
+    // flushed window_msec after its first write, or at once when max_batch
+    // users are pending. Completions run on the flushing worker thread after
+    // the group commit, with whether that user's write is durable.
+    class WriteBehindQueue
+    {
+    public:
+        using Completion = std::function<void(bool is_committed)>;
+
+        static constexpr int DEFAULT_WINDOW_MSEC = 10;
+        static constexpr int DEFAULT_MAX_BATCH = 256;
+
+        WriteBehindQueue(WorkerServerDataBase &data_base, ActiveObject::ProxyActiveObject &workers,
+                         int window_msec = DEFAULT_WINDOW_MSEC, int max_batch = DEFAULT_MAX_BATCH);
+        WriteBehindQueue(const WriteBehindQueue&) = delete;
+        WriteBehindQueue(const WriteBehindQueue&&) = delete;
+        WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+        WriteBehindQueue& operator=(const WriteBehindQueue&&) = delete;
+        virtual ~WriteBehindQueue();
+
+        void insert_addr_info_user(const QString &user, const QString &addr, quint16 port, Completion done = Completion());
+        void change_addr_user(const QString &user, const QString &addr, Completion done = Completion());
+        void change_port_user(const QString &user, quint16 port, Completion done = Completion());
+
+        void flush();
+        int count_pending()const;
+
+    private:
+        struct Mutation
+        {
+            bool is_insert = false;
+            bool has_addr = false;
+            bool has_port = false;
+            QString addr;
+            quint16 port = 0;
+            QList<Completion> completions;
+        };
+
+        // Shared with the queued flush tasks, which may outlive the queue.
+        struct Core
+        {
+            WorkerServerDataBase &data_base;
+            int window_msec;
+            int max_batch;
+            mutable QMutex mutex;
+            QMutex flush_mutex;
+            QHash<QString,Mutation> pending;
+            bool is_scheduled = false;
+
+            Core(WorkerServerDataBase &base, int window, int batch);
+            void flush();
+            bool apply(const QString &user, const Mutation &mutation);
+        };
+
+        void enqueue(const QString &user, const std::function<void(Mutation&)> &merge, Completion done);
+
+        std::shared_ptr<Core> _core;
+        ActiveObject::ProxyActiveObject &_workers;
+    };
+}
+
+#endif // WRITEBEHINDQUEUE_H
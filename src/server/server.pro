@@ -28,20 +28,12 @@ CONFIG += c++11, c++14
 
 SOURCES += \
         main.cpp \
-        mainwindow.cpp \
-    ActiveObject/abstracttask.cpp \
-    ActiveObject/proxyactiveobject.cpp \
-    ActiveObject/scheduler.cpp \
-    BaseServer/base_server.cpp \
-    Workers/workerserverdatabase.cpp
+        mainwindow.cpp
 
 HEADERS += \
-        mainwindow.h \
-    ActiveObject/abstracttask.h \
-    ActiveObject/proxyactiveobject.h \
-    ActiveObject/scheduler.h \
-    BaseServer/base_server.h \
-    Workers/workerserverdatabase.h
+        mainwindow.h
+
+include(server_core.pri)
 
 FORMS += \
         mainwindow.ui
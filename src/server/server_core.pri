@@ -0,0 +1,83 @@
+# Server building blocks shared by the GUI server and the other projects
+
+QT       += network
+QT       += sql
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/ActiveObject/abstracttask.cpp \
+    $$PWD/ActiveObject/proxyactiveobject.cpp \
+    $$PWD/ActiveObject/scheduler.cpp \
+    $$PWD/BaseServer/base_server.cpp \
+    $$PWD/BaseServer/compression.cpp \
+    $$PWD/BaseServer/connection_stats.cpp \
+    $$PWD/BaseServer/token_bucket.cpp \
+    $$PWD/BaseServer/buffer_pool.cpp \
+    $$PWD/BaseServer/protocol.cpp \
+    $$PWD/BaseServer/request_dispatcher.cpp \
+    $$PWD/Sync/xxhash64.cpp \
+    $$PWD/Sync/chunked_transfer.cpp \
+    $$PWD/Sync/storage_path.cpp \
+    $$PWD/Sync/rolling_checksum.cpp \
+    $$PWD/Sync/delta_sync.cpp \
+    $$PWD/Sync/chunk_store.cpp \
+    $$PWD/Sync/merkle_tree.cpp \
+    $$PWD/Sync/file_listing.cpp \
+    $$PWD/Workers/connectionpool.cpp \
+    $$PWD/Workers/schema.cpp \
+    $$PWD/Workers/usercache.cpp \
+    $$PWD/Workers/countingbloomfilter.cpp \
+    $$PWD/Workers/workerserverdatabase.cpp \
+    $$PWD/Workers/writebehindqueue.cpp
+
+HEADERS += \
+    $$PWD/ActiveObject/abstracttask.h \
+    $$PWD/ActiveObject/lockfreequeue.h \
+    $$PWD/ActiveObject/proxyactiveobject.h \
+    $$PWD/ActiveObject/scheduler.h \
+    $$PWD/BaseServer/base_server.h \
+    $$PWD/BaseServer/codec.h \
+    $$PWD/BaseServer/compression.h \
+    $$PWD/BaseServer/connection_context.h \
+    $$PWD/BaseServer/connection_stats.h \
+    $$PWD/BaseServer/timing_wheel.h \
+    $$PWD/BaseServer/token_bucket.h \
+    $$PWD/BaseServer/buffer_pool.h \
+    $$PWD/BaseServer/protocol.h \
+    $$PWD/BaseServer/request_dispatcher.h \
+    $$PWD/Sync/xxhash64.h \
+    $$PWD/Sync/sync_messages.h \
+    $$PWD/Sync/chunked_transfer.h \
+    $$PWD/Sync/storage_path.h \
+    $$PWD/Sync/rolling_checksum.h \
+    $$PWD/Sync/delta_sync.h \
+    $$PWD/Sync/chunk_store.h \
+    $$PWD/Sync/merkle_tree.h \
+    $$PWD/Sync/file_listing.h \
+    $$PWD/Workers/connectionpool.h \
+    $$PWD/Workers/schema.h \
+    $$PWD/Workers/usercache.h \
+    $$PWD/Workers/countingbloomfilter.h \
+    $$PWD/Workers/workerserverdatabase.h \
+    $$PWD/Workers/writebehindqueue.h
+
+linux {
+    SOURCES += \
+        $$PWD/BaseServer/epoll_server.cpp \
+        $$PWD/Sync/file_watcher.cpp
+
+    HEADERS += \
+        $$PWD/BaseServer/epoll_server.h \
+        $$PWD/Sync/file_watcher.h
+}
+
+# Optional payload codecs, e.g. qmake "CONFIG+=lz4 zstd"
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
+zstd {
+    DEFINES += HAVE_ZSTD
+    LIBS += -lzstd
+}
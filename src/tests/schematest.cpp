@@ -0,0 +1,171 @@
+#include "Workers/schema.h"
+
+#include <QtTest>
+#include <QSqlQuery>
+#include <QSqlDatabase>
+
+using namespace DataBaseWork;
+
+namespace
+{
+    // The tables as they were created by hand before Schema existed.
+    const QStringList LEGACY_REQUESTS =
+    {
+        "CREATE TABLE users (name TEXT);",
+        "CREATE TABLE dirs (name TEXT, path TEXT);",
+        "CREATE TABLE files (name TEXT, path TEXT, created_data TEXT, last_modified_data TEXT, size TEXT);",
+        "CREATE TABLE user_addr_info (name TEXT, port INTEGER, addr TEXT);"
+    };
+
+    const QString CREATED = "2020-06-10T15:43:58.123Z";
+    const QString UNPARSEABLE = "last tuesday";
+}
+
+class SchemaTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void creates_tables();
+    void upgrade_is_idempotent();
+    void imports_legacy_tables();
+    void imports_partial_legacy_tables();
+    void round_trips_dates();
+
+private:
+    bool exec(const QString &request);
+    QVariant value(const QString &request);
+    int count(const QString &table);
+
+    QSqlDatabase _base;
+};
+
+void SchemaTest::init()
+{
+    _base = QSqlDatabase::addDatabase("QSQLITE", "schema_test");
+    _base.setDatabaseName(":memory:");
+    QVERIFY(_base.open());
+}
+
+void SchemaTest::cleanup()
+{
+    _base.close();
+    _base = QSqlDatabase();
+    QSqlDatabase::removeDatabase("schema_test");
+}
+
+void SchemaTest::creates_tables()
+{
+    QCOMPARE(Schema::version(_base), 0);
+    QVERIFY(Schema::upgrade(_base));
+    QCOMPARE(Schema::version(_base), Schema::VERSION);
+    for (auto &table : {"users", "dirs", "files", "user_addr_info"})
+    {
+        QCOMPARE(count(table), 0);
+    }
+}
+
+void SchemaTest::upgrade_is_idempotent()
+{
+    QVERIFY(Schema::upgrade(_base));
+    QVERIFY(exec("INSERT INTO users (name) VALUES ('alice');"));
+    QVERIFY(Schema::upgrade(_base));
+    QCOMPARE(Schema::version(_base), Schema::VERSION);
+    QCOMPARE(count("users"), 1);
+}
+
+void SchemaTest::imports_legacy_tables()
+{
+    for (auto &request : LEGACY_REQUESTS)
+    {
+        QVERIFY(exec(request));
+    }
+    QVERIFY(exec("INSERT INTO users (name) VALUES ('alice'), ('bob'), (NULL);"));
+    QVERIFY(exec("INSERT INTO dirs (name,path) VALUES ('alice','docs'), ('alice',NULL), ('ghost','docs');"));
+    QVERIFY(exec(QString("INSERT INTO files (name,path,created_data,last_modified_data,size) VALUES "
+                         "('alice','docs/a.txt','%1','%2','1024'), "
+                         "('alice','docs/b.txt','','2020-06-10T18:43:58.123+03:00','12.0'), "
+                         "('bob','c.txt',NULL,NULL,''), "
+                         "('ghost','d.txt','%1','%1','7');").arg(CREATED, UNPARSEABLE)));
+    QVERIFY(exec("INSERT INTO user_addr_info (name,port,addr) VALUES ('alice',8080,'127.0.0.1'), ('ghost',1,'::1');"));
+
+    QVERIFY(Schema::upgrade(_base));
+    QCOMPARE(Schema::version(_base), Schema::VERSION);
+
+    // Rows without a name or path and rows of users that no longer exist
+    // are dropped.
+    QCOMPARE(count("users"), 2);
+    QCOMPARE(count("dirs"), 1);
+    QCOMPARE(count("files"), 3);
+    QCOMPARE(count("user_addr_info"), 1);
+    QCOMPARE(value("SELECT COUNT(*) FROM sqlite_master WHERE name LIKE 'legacy_%';").toInt(), 0);
+
+    QString alice = "(SELECT id FROM users WHERE name = 'alice')";
+    QCOMPARE(value("SELECT path FROM dirs WHERE user_id = " + alice + ";").toString(), QString("docs"));
+    QCOMPARE(value("SELECT port FROM user_addr_info WHERE user_id = " + alice + ";").toInt(), 8080);
+
+    // Text sizes become integers.
+    QCOMPARE(value("SELECT typeof(size) FROM files WHERE path = 'docs/a.txt';").toString(), QString("integer"));
+    QCOMPARE(value("SELECT size FROM files WHERE path = 'docs/a.txt';").toLongLong(), 1024LL);
+    QCOMPARE(value("SELECT size FROM files WHERE path = 'docs/b.txt';").toLongLong(), 12LL);
+    QCOMPARE(value("SELECT size FROM files WHERE path = 'c.txt';").toLongLong(), 0LL);
+
+    // Dates become msec since the epoch and read back in UTC; dates that do
+    // not parse are kept as text and read back unchanged.
+    QCOMPARE(value("SELECT typeof(created) FROM files WHERE path = 'docs/a.txt';").toString(), QString("integer"));
+    QCOMPARE(Schema::from_epoch(value("SELECT created FROM files WHERE path = 'docs/a.txt';")), CREATED);
+    QCOMPARE(value("SELECT typeof(last_modified) FROM files WHERE path = 'docs/a.txt';").toString(), QString("text"));
+    QCOMPARE(Schema::from_epoch(value("SELECT last_modified FROM files WHERE path = 'docs/a.txt';")), UNPARSEABLE);
+    QCOMPARE(Schema::from_epoch(value("SELECT last_modified FROM files WHERE path = 'docs/b.txt';")), CREATED);
+    QVERIFY(value("SELECT created FROM files WHERE path = 'docs/b.txt';").isNull());
+    QVERIFY(value("SELECT created FROM files WHERE path = 'c.txt';").isNull());
+}
+
+void SchemaTest::imports_partial_legacy_tables()
+{
+    QVERIFY(exec(LEGACY_REQUESTS[0]));
+    QVERIFY(exec("INSERT INTO users (name) VALUES ('alice');"));
+
+    QVERIFY(Schema::upgrade(_base));
+    QCOMPARE(count("users"), 1);
+    QCOMPARE(count("dirs"), 0);
+    QCOMPARE(count("files"), 0);
+    QCOMPARE(count("user_addr_info"), 0);
+}
+
+void SchemaTest::round_trips_dates()
+{
+    QCOMPARE(Schema::normalize_date(CREATED), CREATED);
+    QCOMPARE(Schema::normalize_date("2020-06-10T18:43:58.123+03:00"), CREATED);
+    QCOMPARE(Schema::normalize_date(UNPARSEABLE), UNPARSEABLE);
+    QCOMPARE(Schema::normalize_date(QString()), QString());
+    QCOMPARE(Schema::to_epoch(CREATED).toLongLong(), QDateTime::fromString(CREATED, Qt::ISODateWithMs).toMSecsSinceEpoch());
+}
+
+bool SchemaTest::exec(const QString &request)
+{
+    QSqlQuery query(_base);
+    return query.exec(request);
+}
+
+QVariant SchemaTest::value(const QString &request)
+{
+    QSqlQuery query(_base);
+    if(!query.exec(request) || !query.next())
+    {
+        return QVariant();
+    }
+    return query.value(0);
+}
+
+int SchemaTest::count(const QString &table)
+{
+    return value(QString("SELECT COUNT(*) FROM %1;").arg(table)).toInt();
+}
+
+QTEST_GUILESS_MAIN(SchemaTest)
+
+#include "schematest.moc"
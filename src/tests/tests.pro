@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Tests for the server building blocks
+#
+#-------------------------------------------------
+
+QT       += core testlib sql
+QT       -= gui
+
+TARGET = tests
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+CONFIG += c++11, c++14
+
+INCLUDEPATH += ../server
+
+SOURCES += \
+    schematest.cpp \
+    ../server/Workers/schema.cpp
+
+HEADERS += \
+    ../server/Workers/schema.h